@@ -1,15 +1,28 @@
 #ifndef __PROGTEST__
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdarg>
 #include <cstdint>
+#include <cstdlib>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
 #include <random>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 // We use std::set as a reference to check our implementation.
 // It is not available in progtest :)
@@ -29,6 +42,8 @@ struct Ref {
 
 	auto begin() const { return _data.begin(); }
 	auto end() const { return _data.end(); }
+	auto lower_bound(const T &value) const { return _data.lower_bound(value); }
+	auto upper_bound(const T &value) const { return _data.upper_bound(value); }
 
 private:
 	std::set<T> _data;
@@ -36,6 +51,10 @@ private:
 
 #endif
 
+// The code outside of the __PROGTEST__ blocks is compiled on Progtest with only the headers of its template: <array>, <cassert>,
+// <cstdarg>, <cstdint>, <iomanip>, <iostream>, <limits>, <memory>, <optional>, <random> and <type_traits>. Of the rest of the library
+// it uses only std::less, which the Tree of the template used too, and std::move, std::forward, std::swap and std::pair, which
+// these headers are built on. Containers and algorithms of other headers are written by hand.
 namespace config {
 	// Enable to check that the tree is AVL balanced.
 	inline constexpr bool CHECK_DEPTH = true;
@@ -44,73 +63,273 @@ namespace config {
 	inline constexpr bool PARENT_POINTERS = true;
 }
 
-template <typename T>
-struct Tree {
-	struct Node {
-		Node *m_parent;
-		Node *m_leftChild;
-		Node *m_rightChild;
-		T m_value;
-		ssize_t m_sign;
-		size_t m_height;
-		Node(T value) : m_value(value) {
-			// sanity check
-			m_parent = nullptr;
-			m_leftChild = nullptr;
-			m_rightChild = nullptr;
-			m_sign = 0;
-			m_height = 0;
+// Allocates every node by itself with new
+struct HeapNodes {
+	template <typename Node>
+	struct Pool {
+		// whether release frees all the nodes at once
+		static constexpr bool BULK_RELEASE = false;
+
+		template <typename... Args>
+		Node *create(Args &&...args) {
+			return new Node(std::forward<Args>(args)...);
+		}
+
+		void destroy(Node *node) {
+			delete node;
+		}
+
+		void release() {}
+
+		void adopt(Pool &) {}
+	};
+};
+
+// Allocates the nodes from slabs of SLAB_NODES nodes, owned by the tree, so that they lie close together.
+// Erased nodes go to a free list and are reused by the next inserts, the slabs are freed only all at once.
+template <size_t SLAB_NODES = 1024>
+struct SlabNodes {
+	template <typename Node>
+	struct Pool {
+		static constexpr bool BULK_RELEASE = true;
+
+		union Slot {
+			Slot *next;
+			alignas(Node) unsigned char node[sizeof(Node)];
+		};
+
+		struct Slab {
+			Slot slots[SLAB_NODES];
+			Slab *next; // the slab allocated before
+		};
+
+		// the last allocated slab, the others are linked from it
+		Slab *m_slabs = nullptr;
+		Slot *m_free = nullptr;
+		// slots of the last slab that were never used
+		size_t m_unused = 0;
+
+		Pool() = default;
+
+		Pool(Pool &&other) noexcept : m_slabs(other.m_slabs), m_free(other.m_free), m_unused(other.m_unused) {
+			other.m_slabs = nullptr;
+			other.m_free = nullptr;
+			other.m_unused = 0;
+		}
+
+		Pool &operator=(Pool &&other) noexcept {
+			if (this != &other) {
+				release();
+				m_slabs = other.m_slabs;
+				m_free = other.m_free;
+				m_unused = other.m_unused;
+				other.m_slabs = nullptr;
+				other.m_free = nullptr;
+				other.m_unused = 0;
+			}
+			return *this;
+		}
+
+		~Pool() {
+			release();
 		}
 
-		bool operator<(const Node &other) const {
-			return std::less<T>{}(m_value, other.m_value);
+		template <typename... Args>
+		Node *create(Args &&...args) {
+			Slot *slot = m_free;
+			if (slot) {
+				m_free = slot->next;
+			} else {
+				if (!m_unused) {
+					Slab *slab = new Slab;
+					slab->next = m_slabs;
+					m_slabs = slab;
+					m_unused = SLAB_NODES;
+				}
+				slot = &m_slabs->slots[SLAB_NODES - m_unused--];
+			}
+			try {
+				return new (slot->node) Node(std::forward<Args>(args)...);
+			} catch (...) {
+				slot->next = m_free;
+				m_free = slot;
+				throw;
+			}
 		}
 
-		bool operator>(const Node &other) const {
-			return std::less<T>{}(other.m_value, m_value);
+		void destroy(Node *node) {
+			node->~Node();
+			Slot *slot = reinterpret_cast<Slot *>(node);
+			slot->next = m_free;
+			m_free = slot;
 		}
 
-		bool operator==(const Node &other) const {
-			return !(*this < other) && !(other < *this);
+		// Frees the memory of all the nodes, their values have to be destroyed before
+		void release() {
+			while (m_slabs) {
+				Slab *next = m_slabs->next;
+				delete m_slabs;
+				m_slabs = next;
+			}
+			m_free = nullptr;
+			m_unused = 0;
 		}
 
-		bool operator!=(const Node &other) const {
-			return (*this < other) || (other < *this);
+		// Puts the slots of the last slab that were never used to the free list
+		void freeUnused() {
+			while (m_unused) {
+				Slot *slot = &m_slabs->slots[SLAB_NODES - m_unused--];
+				slot->next = m_free;
+				m_free = slot;
+			}
 		}
 
-		void calculateNewSign() {
-			m_sign = 0;
-			if (m_leftChild) {
-				m_sign -= m_leftChild->m_height + 1;
+		// Takes the slabs of the other pool, with the nodes in them
+		void adopt(Pool &other) {
+			// the last slab will not be the last one any more
+			freeUnused();
+			other.freeUnused();
+			if (other.m_free) {
+				Slot *last = other.m_free;
+				while (last->next) {
+					last = last->next;
+				}
+				last->next = m_free;
+				m_free = other.m_free;
 			}
-			if (m_rightChild) {
-				m_sign += m_rightChild->m_height + 1;
+			if (other.m_slabs) {
+				Slab *last = other.m_slabs;
+				while (last->next) {
+					last = last->next;
+				}
+				last->next = m_slabs;
+				m_slabs = other.m_slabs;
 			}
+			other.m_slabs = nullptr;
+			other.m_free = nullptr;
+		}
+	};
+};
+
+// Augmentations keep a summary of the subtree in every node, the node inherits their Data.
+// update recalculates it from the value and the data of the children, whenever the height of the node is recalculated.
+struct NoAugment {
+	static constexpr bool ENABLED = false;
+
+	template <typename T>
+	struct Data {
+		void update(const T &, const Data *, const Data *) {}
+	};
+};
+
+// Sizes of the subtrees, for select and rank
+struct SubtreeSizes {
+	static constexpr bool ENABLED = true;
+
+	template <typename T>
+	struct Data {
+		size_t m_size = 1;
+
+		void update(const T &, const Data *left, const Data *right) {
+			m_size = 1 + (left ? left->m_size : 0) + (right ? right->m_size : 0);
 		}
+	};
+};
 
-		void calculateNewHeight() {
-			m_height = 0;
-			if (m_leftChild) {
-				m_height = m_leftChild->m_height + 1;
+// Aggregates of the values of the subtrees by the Monoid, which has Value, identity(), of(value), the Value of a value,
+// and combine(a, b), associative but not necessarily commutative, that is applied to the values in order
+template <typename M>
+struct Aggregate {
+	static constexpr bool ENABLED = true;
+	using Monoid = M;
+
+	template <typename T>
+	struct Data {
+		typename Monoid::Value m_aggregate = Monoid::identity();
+
+		void update(const T &value, const Data *left, const Data *right) {
+			m_aggregate = Monoid::of(value);
+			if (left) {
+				m_aggregate = Monoid::combine(left->m_aggregate, m_aggregate);
 			}
-			if (m_rightChild && m_height < m_rightChild->m_height + 1) {
-				m_height = m_rightChild->m_height + 1;
+			if (right) {
+				m_aggregate = Monoid::combine(m_aggregate, right->m_aggregate);
 			}
+		}
+	};
+};
+
+template <typename T>
+struct Sum {
+	using Value = T;
+	static Value identity() { return T(); }
+	static Value of(const T &value) { return value; }
+	static Value combine(const Value &a, const Value &b) { return a + b; }
+};
+
+template <typename T>
+struct Min {
+	using Value = T;
+	static Value identity() { return std::numeric_limits<T>::max(); }
+	static Value of(const T &value) { return value; }
+	static Value combine(const Value &a, const Value &b) { return b < a ? b : a; }
+};
+
+template <typename T>
+struct Max {
+	using Value = T;
+	static Value identity() { return std::numeric_limits<T>::lowest(); }
+	static Value of(const T &value) { return value; }
+	static Value combine(const Value &a, const Value &b) { return a < b ? b : a; }
+};
+
+// Compare orders the values like std::less, a transparent Compare (with is_transparent, e.g. std::less<>)
+// also lets find and erase take keys of other types, which are compared with the values directly, without copying them into a T.
+// Nodes allocates the nodes, HeapNodes or SlabNodes. Augment keeps subtree summaries in the nodes, NoAugment costs nothing.
+template <typename T, typename Compare = std::less<T>, typename Nodes = HeapNodes, typename Augment = NoAugment>
+struct Tree {
+	using Data = typename Augment::template Data<T>;
 
-			calculateNewSign();
+	struct Node : Data {
+		Node *m_parent;
+		Node *m_leftChild;
+		Node *m_rightChild;
+		T m_value;
+		// levels of the right subtree minus those of the left one, -1, 0 or 1 (-2 or 2 only until it is rotated)
+		signed char m_balance;
+		template <typename... Args>
+		explicit Node(Args &&...args) : m_value(std::forward<Args>(args)...) {
+			// sanity check
+			m_parent = nullptr;
+			m_leftChild = nullptr;
+			m_rightChild = nullptr;
+			m_balance = 0;
+			this->update(m_value, nullptr, nullptr);
 		}
 
-		void swapValues(Node &other) {
-			T temp = m_value;
-			m_value = other.m_value;
-			other.m_value = temp;
+		void updateData() {
+			this->update(m_value, m_leftChild, m_rightChild);
 		}
 	};
 
 	Node *m_root;
 	size_t m_size;
+	Compare m_compare;
+	typename Nodes::template Pool<Node> m_nodes;
+
+	// Negative if the key belongs to the left of the node, positive if to the right, zero if it is the node's value.
+	// A level which goes left costs one comparison, a level which goes right or finds the value costs two, the second one is saved only on the left.
+	template <typename K>
+	int compare(const K &key, const Node *node) const {
+		if (m_compare(key, node->m_value)) {
+			return -1;
+		}
+		return m_compare(node->m_value, key) ? 1 : 0;
+	}
 
-	void leftRotate(Node *x) {
+	// The rotations update root, the root of the tree or of the detached subtree, when they rotate it.
+	// The new balance factors follow from the old ones, no heights are needed.
+	void leftRotate(Node *x, Node *&root) {
 		Node *parent = x->m_parent;
 		Node *y = x->m_rightChild;
 
@@ -124,11 +343,13 @@ struct Tree {
 		x->m_rightChild = subtreeB;
 		y->m_parent = parent;
 
-		x->calculateNewHeight();
-		y->calculateNewHeight();
+		x->m_balance -= 1 + (y->m_balance > 0 ? y->m_balance : 0);
+		y->m_balance -= 1 - (x->m_balance < 0 ? x->m_balance : 0);
+		x->updateData();
+		y->updateData();
 
 		if (!parent) {
-			m_root = y;
+			root = y;
 			return;
 		}
 		if (parent->m_leftChild == x) {
@@ -138,7 +359,7 @@ struct Tree {
 		parent->m_rightChild = y;
 	}
 
-	void rightRotate(Node *x) {
+	void rightRotate(Node *x, Node *&root) {
 		Node *parent = x->m_parent;
 		Node *y = x->m_leftChild;
 
@@ -152,11 +373,13 @@ struct Tree {
 		x->m_leftChild = subtreeB;
 		y->m_parent = parent;
 
-		x->calculateNewHeight();
-		y->calculateNewHeight();
+		x->m_balance += 1 - (y->m_balance < 0 ? y->m_balance : 0);
+		y->m_balance += 1 + (x->m_balance > 0 ? x->m_balance : 0);
+		x->updateData();
+		y->updateData();
 
 		if (!parent) {
-			m_root = y;
+			root = y;
 			return;
 		}
 		if (parent->m_leftChild == x) {
@@ -166,47 +389,102 @@ struct Tree {
 		parent->m_rightChild = y;
 	}
 
-	void leftRightRotate(Node *x) {
-		leftRotate(x->m_leftChild);
-		rightRotate(x);
+	void leftRightRotate(Node *x, Node *&root) {
+		leftRotate(x->m_leftChild, root);
+		rightRotate(x, root);
 	}
 
-	void rightLeftRotate(Node *x) {
-		rightRotate(x->m_rightChild);
-		leftRotate(x);
+	void rightLeftRotate(Node *x, Node *&root) {
+		rightRotate(x->m_rightChild, root);
+		leftRotate(x, root);
 	}
 
 	size_t size() const {
 		return m_size;
 	}
 
-	Node *findByValue(const T &value) const {
-		Node toFind(value);
+	template <typename K>
+	Node *findByValue(const K &key) const {
 		Node *visiting = m_root;
-		while (visiting != nullptr && *visiting != toFind) {
-			visiting = *visiting > toFind ? visiting->m_leftChild : visiting->m_rightChild;
+		while (visiting) {
+			int side = compare(key, visiting);
+			if (side == 0) {
+				break;
+			}
+			visiting = side < 0 ? visiting->m_leftChild : visiting->m_rightChild;
 		}
 		return visiting;
 	}
 
-	void balance(Node *visiting) {
-		while (visiting) {
-			// calculate new height
-			visiting->calculateNewHeight();
-			if (visiting->m_sign < -1) {
-				if (visiting->m_leftChild && visiting->m_leftChild->m_sign == 1) {
-					leftRightRotate(visiting);
-				} else {
-					rightRotate(visiting);
-				}
-			} else if (visiting->m_sign > 1) {
-				if (visiting->m_rightChild && visiting->m_rightChild->m_sign == -1) {
-					rightLeftRotate(visiting);
-				} else {
-					leftRotate(visiting);
-				}
+	// Rotates the node whose balance factor reached -2 or 2, returns the new root of its subtree
+	Node *rotateUnbalanced(Node *n, Node *&root) {
+		if (n->m_balance < 0) {
+			if (n->m_leftChild->m_balance > 0) {
+				leftRightRotate(n, root);
+			} else {
+				rightRotate(n, root);
+			}
+		} else {
+			if (n->m_rightChild->m_balance < 0) {
+				rightLeftRotate(n, root);
+			} else {
+				leftRotate(n, root);
+			}
+		}
+		return n->m_parent;
+	}
+
+	// The augmentations of the node and its ancestors, when the retracing stops below them
+	static void updateUp(Node *n) {
+		if constexpr (Augment::ENABLED) {
+			for (; n; n = n->m_parent) {
+				n->updateData();
+			}
+		}
+	}
+
+	// Retraces from the node whose subtree grew by one level, like a new leaf. The balance factors change only up to
+	// the first ancestor whose height stays, usually one or two levels up. Returns whether the whole subtree of root grew.
+	bool retraceGrown(Node *grown, Node *&root) {
+		for (Node *parent = grown->m_parent; parent; parent = grown->m_parent) {
+			parent->m_balance += parent->m_rightChild == grown ? 1 : -1;
+			if (parent->m_balance == 0) {
+				updateUp(parent);
+				return false;
 			}
-			visiting = visiting->m_parent;
+			if (parent->m_balance == 1 || parent->m_balance == -1) {
+				parent->updateData();
+				grown = parent;
+				continue;
+			}
+			grown = rotateUnbalanced(parent, root);
+			// the rotation restores the height after an insert, after a join it may not
+			if (grown->m_balance == 0) {
+				updateUp(grown->m_parent);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Retraces from the parent whose child on the side (-1 left, 1 right) lost a level, like after an erase.
+	// The balance factors change only up to the first ancestor whose height stays.
+	void retraceShrunk(Node *parent, int side, Node *&root) {
+		while (parent) {
+			parent->m_balance -= side;
+			Node *top = parent;
+			if (parent->m_balance == 2 || parent->m_balance == -2) {
+				top = rotateUnbalanced(parent, root);
+			} else {
+				parent->updateData();
+			}
+			// the subtree lost a level only if it became balanced
+			if (top->m_balance != 0) {
+				updateUp(top->m_parent);
+				return;
+			}
+			parent = top->m_parent;
+			side = parent && parent->m_rightChild == top ? 1 : -1;
 		}
 	}
 
@@ -214,35 +492,99 @@ struct Tree {
 		Node *found = findByValue(value);
 		return found ? &(found->m_value) : nullptr;
 	}
-	bool insert(T value) {
-		Node *toInsert = new Node(value);
-		// if tree is empty
-		if (!m_root) {
-			m_root = toInsert;
-			++m_size;
-			return true;
-		}
 
-		Node *visiting = m_root;
-		bool left = true;
+	// Only with a transparent Compare
+	template <typename K, typename C = Compare, typename = typename C::is_transparent>
+	const T *find(const K &key) const {
+		Node *found = findByValue(key);
+		return found ? &(found->m_value) : nullptr;
+	}
+
+	// Finds the parent and the side of the place where the key belongs in the subtree of visiting, false if the key
+	// is already there, then parent is its node
+	template <typename K>
+	bool findPlace(Node *visiting, const K &key, Node *&parent, int &side) const {
+		parent = nullptr;
+		side = 0;
 		while (visiting) {
-			toInsert->m_parent = visiting;
-			if (*toInsert == *visiting) {
-				delete toInsert;
+			side = compare(key, visiting);
+			if (side == 0) {
+				parent = visiting;
 				return false;
 			}
-			left = *toInsert < *visiting;
-			visiting = left ? visiting->m_leftChild : visiting->m_rightChild;
+			parent = visiting;
+			visiting = side < 0 ? visiting->m_leftChild : visiting->m_rightChild;
 		}
-		if (left) {
-			toInsert->m_parent->m_leftChild = toInsert;
+		return true;
+	}
+
+	template <typename K>
+	bool findPlace(const K &key, Node *&parent, int &side) const {
+		return findPlace(m_root, key, parent, side);
+	}
+
+	void link(Node *toInsert, Node *parent, int side) {
+		toInsert->m_parent = parent;
+		++m_size;
+		// if tree is empty
+		if (!parent) {
+			m_root = toInsert;
+			return;
+		}
+		if (side < 0) {
+			parent->m_leftChild = toInsert;
 		} else {
-			toInsert->m_parent->m_rightChild = toInsert;
+			parent->m_rightChild = toInsert;
 		}
-		++m_size;
+		retraceGrown(toInsert, m_root);
+	}
+
+	// The value is copied or moved into a node only if it is not in the tree yet
+	bool insert(const T &value) {
+		return emplace(value);
+	}
+
+	bool insert(T &&value) {
+		return emplace(std::move(value));
+	}
+
+	template <typename C, typename = void>
+	struct IsTransparent : std::false_type {};
+	template <typename C>
+	struct IsTransparent<C, std::void_t<typename C::is_transparent>> : std::true_type {};
 
-		balance(toInsert->m_parent);
+	// Whether emplace can look up its only argument before it constructs the value
+	template <typename... Args>
+	static constexpr bool isKey() {
+		if constexpr (sizeof...(Args) != 1) {
+			return false;
+		} else if constexpr ((std::is_same_v<std::decay_t<Args>, T> && ...)) {
+			return true;
+		} else {
+			return IsTransparent<Compare>::value &&
+				   (std::is_invocable_r_v<bool, const Compare &, const std::decay_t<Args> &, const T &> && ...);
+		}
+	}
 
+	// Constructs the value in place from the arguments. If the only argument is a value or a key, the node is allocated
+	// only after the key is known to be absent, otherwise the value has to be constructed before it can be looked up.
+	template <typename... Args>
+	bool emplace(Args &&...args) {
+		Node *parent;
+		int side;
+		if constexpr (isKey<Args...>()) {
+			if (!findPlace(args..., parent, side)) {
+				return false;
+			}
+			link(m_nodes.create(std::forward<Args>(args)...), parent, side);
+		} else {
+			Node *toInsert = m_nodes.create(std::forward<Args>(args)...);
+			if (!findPlace(toInsert->m_value, parent, side)) {
+				m_nodes.destroy(toInsert);
+				return false;
+			}
+			link(toInsert, parent, side);
+		}
 		return true;
 	}
 
@@ -250,92 +592,1999 @@ struct Tree {
 		if (!n) {
 			return nullptr;
 		}
-		while (n->m_leftChild) {
-			n = n->m_leftChild;
+		while (n->m_leftChild) {
+			n = n->m_leftChild;
+		}
+		return n;
+	}
+
+	Node *findMax(Node *n) const {
+		if (!n) {
+			return nullptr;
+		}
+		while (n->m_rightChild) {
+			n = n->m_rightChild;
+		}
+		return n;
+	}
+
+	// Bidirectional iterator in order of the values, which cannot be changed. It moves along the parent pointers,
+	// so a step takes O(1) amortized. Erasing the value invalidates only the iterators to it.
+	struct Iterator {
+#ifndef __PROGTEST__
+		// the category and the difference need <iterator> and <cstddef>, without them the iterator just does not work with std::iterator_traits
+		using iterator_category = std::bidirectional_iterator_tag;
+		using difference_type = std::ptrdiff_t;
+#endif
+		using value_type = T;
+		using pointer = const T *;
+		using reference = const T &;
+
+		const Tree *m_tree = nullptr;
+		// nullptr for the end
+		Node *m_node = nullptr;
+
+		reference operator*() const { return m_node->m_value; }
+		pointer operator->() const { return &m_node->m_value; }
+
+		Iterator &operator++() {
+			m_node = successor(m_node);
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			Iterator old = *this;
+			++*this;
+			return old;
+		}
+
+		Iterator &operator--() {
+			m_node = m_node ? predecessor(m_node) : m_tree->findMax(m_tree->m_root);
+			return *this;
+		}
+
+		Iterator operator--(int) {
+			Iterator old = *this;
+			--*this;
+			return old;
+		}
+
+		bool operator==(const Iterator &other) const { return m_node == other.m_node; }
+		bool operator!=(const Iterator &other) const { return m_node != other.m_node; }
+	};
+
+	using iterator = Iterator;
+	using const_iterator = Iterator;
+
+	Iterator begin() const {
+		return {this, findMin(m_root)};
+	}
+
+	Iterator end() const {
+		return {this, nullptr};
+	}
+
+	// The first node whose value is not less than the key
+	template <typename K>
+	Node *lowerBound(const K &key) const {
+		Node *bound = nullptr;
+		Node *visiting = m_root;
+		while (visiting) {
+			if (m_compare(visiting->m_value, key)) {
+				visiting = visiting->m_rightChild;
+			} else {
+				bound = visiting;
+				visiting = visiting->m_leftChild;
+			}
+		}
+		return bound;
+	}
+
+	// The first node whose value is greater than the key
+	template <typename K>
+	Node *upperBound(const K &key) const {
+		Node *bound = nullptr;
+		Node *visiting = m_root;
+		while (visiting) {
+			if (m_compare(key, visiting->m_value)) {
+				bound = visiting;
+				visiting = visiting->m_leftChild;
+			} else {
+				visiting = visiting->m_rightChild;
+			}
+		}
+		return bound;
+	}
+
+	template <typename K, typename F>
+	void forEachInRange(const K &from, const K &to, F &f) const {
+		for (Node *n = lowerBound(from); n && m_compare(n->m_value, to); n = successor(n)) {
+			f(n->m_value);
+		}
+	}
+
+	Iterator lower_bound(const T &value) const {
+		return {this, lowerBound(value)};
+	}
+
+	Iterator upper_bound(const T &value) const {
+		return {this, upperBound(value)};
+	}
+
+	std::pair<Iterator, Iterator> equal_range(const T &value) const {
+		return {lower_bound(value), upper_bound(value)};
+	}
+
+	// Calls f with the values in [from, to) in order, in O(log n + k) for k values
+	template <typename F>
+	void for_each_in_range(const T &from, const T &to, F &&f) const {
+		forEachInRange(from, to, f);
+	}
+
+	// Only with a transparent Compare
+	template <typename K, typename C = Compare, typename = typename C::is_transparent>
+	Iterator lower_bound(const K &key) const {
+		return {this, lowerBound(key)};
+	}
+
+	template <typename K, typename C = Compare, typename = typename C::is_transparent>
+	Iterator upper_bound(const K &key) const {
+		return {this, upperBound(key)};
+	}
+
+	template <typename K, typename C = Compare, typename = typename C::is_transparent>
+	std::pair<Iterator, Iterator> equal_range(const K &key) const {
+		return {lower_bound(key), upper_bound(key)};
+	}
+
+	template <typename K, typename F, typename C = Compare, typename = typename C::is_transparent>
+	void for_each_in_range(const K &from, const K &to, F &&f) const {
+		forEachInRange(from, to, f);
+	}
+
+	static size_t sizeOf(const Node *n) {
+		return n ? n->m_size : 0;
+	}
+
+	// The k-th smallest value, counted from 0, in O(log n), nullptr if there are not so many values.
+	// Only with SubtreeSizes.
+	const T *select(size_t k) const {
+		static_assert(std::is_same_v<Augment, SubtreeSizes>, "select needs the SubtreeSizes augmentation");
+		Node *visiting = m_root;
+		while (visiting) {
+			size_t left = sizeOf(visiting->m_leftChild);
+			if (k == left) {
+				return &visiting->m_value;
+			}
+			if (k < left) {
+				visiting = visiting->m_leftChild;
+			} else {
+				k -= left + 1;
+				visiting = visiting->m_rightChild;
+			}
+		}
+		return nullptr;
+	}
+
+	// The number of values less than the key, in O(log n). Only with SubtreeSizes.
+	template <typename K>
+	size_t rankOf(const K &key) const {
+		static_assert(std::is_same_v<Augment, SubtreeSizes>, "rank needs the SubtreeSizes augmentation");
+		size_t rank = 0;
+		Node *visiting = m_root;
+		while (visiting) {
+			if (m_compare(visiting->m_value, key)) {
+				rank += sizeOf(visiting->m_leftChild) + 1;
+				visiting = visiting->m_rightChild;
+			} else {
+				visiting = visiting->m_leftChild;
+			}
+		}
+		return rank;
+	}
+
+	size_t rank(const T &value) const {
+		return rankOf(value);
+	}
+
+	// Only with a transparent Compare
+	template <typename K, typename C = Compare, typename = typename C::is_transparent>
+	size_t rank(const K &key) const {
+		return rankOf(key);
+	}
+
+	// The aggregate of the values in [from, to), in O(log n). Only with an Aggregate.
+	// It descends to the highest node in the range, then along the bounds, taking whole subtrees between them.
+	template <typename K, typename A = Augment>
+	typename A::Monoid::Value rangeAggregate(const K &from, const K &to) const {
+		using Monoid = typename A::Monoid;
+		Node *top = m_root;
+		while (top) {
+			if (m_compare(top->m_value, from)) {
+				top = top->m_rightChild;
+			} else if (!m_compare(top->m_value, to)) {
+				top = top->m_leftChild;
+			} else {
+				break;
+			}
+		}
+		if (!top) {
+			return Monoid::identity();
+		}
+
+		// the values of the left subtree from the lower bound, found from the greatest ones
+		auto suffix = Monoid::identity();
+		for (Node *visiting = top->m_leftChild; visiting;) {
+			if (m_compare(visiting->m_value, from)) {
+				visiting = visiting->m_rightChild;
+				continue;
+			}
+			if (visiting->m_rightChild) {
+				suffix = Monoid::combine(visiting->m_rightChild->m_aggregate, suffix);
+			}
+			suffix = Monoid::combine(Monoid::of(visiting->m_value), suffix);
+			visiting = visiting->m_leftChild;
+		}
+		// the values of the right subtree up to the upper bound, found from the least ones
+		auto prefix = Monoid::identity();
+		for (Node *visiting = top->m_rightChild; visiting;) {
+			if (!m_compare(visiting->m_value, to)) {
+				visiting = visiting->m_leftChild;
+				continue;
+			}
+			if (visiting->m_leftChild) {
+				prefix = Monoid::combine(prefix, visiting->m_leftChild->m_aggregate);
+			}
+			prefix = Monoid::combine(prefix, Monoid::of(visiting->m_value));
+			visiting = visiting->m_rightChild;
+		}
+		return Monoid::combine(Monoid::combine(suffix, Monoid::of(top->m_value)), prefix);
+	}
+
+	template <typename A = Augment>
+	typename A::Monoid::Value range_aggregate(const T &from, const T &to) const {
+		return rangeAggregate(from, to);
+	}
+
+	// Only with a transparent Compare
+	template <typename K, typename C = Compare, typename = typename C::is_transparent, typename A = Augment>
+	typename A::Monoid::Value range_aggregate(const K &from, const K &to) const {
+		return rangeAggregate(from, to);
+	}
+
+	// The aggregate of all the values
+	template <typename A = Augment>
+	typename A::Monoid::Value aggregate() const {
+		return m_root ? m_root->m_aggregate : A::Monoid::identity();
+	}
+
+	void eraseSubMethod(Node *toDelete, Node *subChild) {
+		// set toDelete's parent as parent of toDelete's only child (if it exists)
+		if (subChild) {
+			subChild->m_parent = toDelete->m_parent;
+		}
+		// if parent exists, set it's child as this child
+		if (toDelete->m_parent) {
+			if (toDelete->m_parent->m_leftChild == toDelete) {
+				toDelete->m_parent->m_leftChild = subChild;
+			} else {
+				toDelete->m_parent->m_rightChild = subChild;
+			}
+		} else { // parent doesn't exist - toDelete is root - set this child as root
+			m_root = subChild;
+		}
+	}
+
+	bool erase(const T &value) {
+		return eraseByKey(value);
+	}
+
+	// Only with a transparent Compare
+	template <typename K, typename C = Compare, typename = typename C::is_transparent>
+	bool erase(const K &key) {
+		return eraseByKey(key);
+	}
+
+	template <typename K>
+	bool eraseByKey(const K &key) {
+		Node *toDelete = findByValue(key);
+		// case 1 - this node is not in tree
+		if (!toDelete) {
+			return false;
+		}
+
+		if (toDelete->m_leftChild && toDelete->m_rightChild) {
+			// case 4 - this node has two children - the minimum of the right subtree is moved to its place,
+			// the nodes are relinked so that no value is copied
+			Node *min = findMin(toDelete->m_rightChild);
+			// the min has no left child, so the subtree it leaves loses a level
+			Node *retraceFrom = min;
+			int side = 1;
+			if (min != toDelete->m_rightChild) {
+				retraceFrom = min->m_parent;
+				side = -1;
+				eraseSubMethod(min, min->m_rightChild);
+				min->m_rightChild = toDelete->m_rightChild;
+				min->m_rightChild->m_parent = min;
+			}
+			min->m_leftChild = toDelete->m_leftChild;
+			min->m_leftChild->m_parent = min;
+			eraseSubMethod(toDelete, min);
+			min->m_balance = toDelete->m_balance;
+
+			m_nodes.destroy(toDelete);
+			--m_size;
+			retraceShrunk(retraceFrom, side, m_root);
+			return true;
+		}
+		Node *parent = toDelete->m_parent;
+		int side = parent && parent->m_rightChild == toDelete ? 1 : -1;
+		// case 2 - this node is a leaf
+		if (!toDelete->m_leftChild && !toDelete->m_rightChild) {
+			eraseSubMethod(toDelete, nullptr);
+		}
+		// case 3 - this node has one child
+		// case 3.1 - the child is left
+		if (toDelete->m_leftChild && !toDelete->m_rightChild) {
+			eraseSubMethod(toDelete, toDelete->m_leftChild);
+		}
+		// case 3.2 - the child is right
+		if (!toDelete->m_leftChild && toDelete->m_rightChild) {
+			eraseSubMethod(toDelete, toDelete->m_rightChild);
+		}
+
+		// delete the node itself
+		m_nodes.destroy(toDelete);
+		--m_size;
+		retraceShrunk(parent, side, m_root);
+		return true;
+	}
+
+	// Number of levels of the subtree, counted along the taller children in O(log n)
+	static size_t heightOf(const Node *n) {
+		size_t height = 0;
+		for (; n; height++) {
+			n = n->m_balance < 0 ? n->m_leftChild : n->m_rightChild;
+		}
+		return height;
+	}
+
+	// Number of levels of the child on the side of the node, whose subtree has height levels
+	static size_t childHeight(const Node *n, size_t height, int side) {
+		return height - (side * n->m_balance < 0 ? 2 : 1);
+	}
+
+	// The next node in order
+	static Node *successor(Node *n) {
+		if (n->m_rightChild) {
+			n = n->m_rightChild;
+			while (n->m_leftChild) {
+				n = n->m_leftChild;
+			}
+			return n;
+		}
+		while (n->m_parent && n->m_parent->m_rightChild == n) {
+			n = n->m_parent;
+		}
+		return n->m_parent;
+	}
+
+	// The previous node in order
+	static Node *predecessor(Node *n) {
+		if (n->m_leftChild) {
+			n = n->m_leftChild;
+			while (n->m_rightChild) {
+				n = n->m_rightChild;
+			}
+			return n;
+		}
+		while (n->m_parent && n->m_parent->m_leftChild == n) {
+			n = n->m_parent;
+		}
+		return n->m_parent;
+	}
+
+	// Number of the values first..last, walked one by one like std::distance of <iterator> does for iterators that are not random access
+	template <typename It>
+	static size_t rangeSize(It first, It last) {
+		size_t size = 0;
+		for (; first != last; ++first) {
+			++size;
+		}
+		return size;
+	}
+
+	// Builds a perfectly balanced subtree of the next count nodes made in order by next(), its root has no parent.
+	// The heights of the halves differ by at most one, so every node is balanced. Sets height to its levels.
+	template <typename Next>
+	static Node *buildBalanced(size_t count, Next &next, size_t &height) {
+		if (!count) {
+			height = 0;
+			return nullptr;
+		}
+		size_t leftCount = count / 2;
+		size_t leftHeight, rightHeight;
+		Node *left = buildBalanced(leftCount, next, leftHeight);
+		Node *n = next();
+		Node *right = buildBalanced(count - 1 - leftCount, next, rightHeight);
+		n->m_parent = nullptr;
+		n->m_leftChild = left;
+		n->m_rightChild = right;
+		if (left) {
+			left->m_parent = n;
+		}
+		if (right) {
+			right->m_parent = n;
+		}
+		n->m_balance = rightHeight - leftHeight;
+		n->updateData();
+		height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+		return n;
+	}
+
+	// Builds the tree of the values first..last in O(n), they have to be sorted without duplicates
+	template <typename It>
+	static Tree from_sorted(It first, It last, const Compare &compare = Compare()) {
+		Tree tree(compare);
+		tree.m_size = rangeSize(first, last);
+		auto next = [&]() {
+			Node *n = tree.m_nodes.create(*first);
+			++first;
+			return n;
+		};
+		size_t height;
+		tree.m_root = buildBalanced(tree.m_size, next, height);
+		return tree;
+	}
+
+	// A batch with at least 1 / DENSE_BATCH values of the tree is merged with it, a sparser one is inserted value by value
+	static constexpr size_t DENSE_BATCH = 2;
+
+	// Inserts the values first..last, which have to be sorted without duplicates, the values already in the tree are skipped.
+	// A dense batch is merged with the values of the tree and the tree is rebuilt balanced in O(n + m), the values
+	// of a sparse batch are inserted from the last inserted one, so that the descents start low. Returns the number of inserted values.
+	template <typename It>
+	size_t insert_sorted_batch(It first, It last) {
+		size_t count = rangeSize(first, last);
+		size_t before = m_size;
+		if (count * DENSE_BATCH >= m_size) {
+			std::unique_ptr<Node *[]> merged(new Node *[m_size + count]);
+			size_t mergedCount = 0;
+			Node *visiting = findMin(m_root);
+			for (; first != last; ++first) {
+				int side = 1;
+				while (visiting && (side = compare(*first, visiting)) > 0) {
+					merged[mergedCount++] = visiting;
+					visiting = successor(visiting);
+				}
+				if (!visiting || side < 0) {
+					merged[mergedCount++] = m_nodes.create(*first);
+				}
+			}
+			for (; visiting; visiting = successor(visiting)) {
+				merged[mergedCount++] = visiting;
+			}
+			m_size = mergedCount;
+			auto next = [it = merged.get()]() mutable { return *it++; };
+			size_t height;
+			m_root = buildBalanced(m_size, next, height);
+			return m_size - before;
+		}
+
+		Node *finger = nullptr;
+		for (; first != last; ++first) {
+			Node *start = m_root;
+			if (finger) {
+				// climb to the lowest ancestor whose subtree holds the place of the value, which is greater than the finger
+				start = finger;
+				while (start->m_parent && !(start->m_parent->m_leftChild == start && compare(*first, start->m_parent) < 0)) {
+					start = start->m_parent;
+				}
+			}
+			Node *parent;
+			int side;
+			if (!findPlace(start, *first, parent, side)) {
+				finger = parent;
+				continue;
+			}
+			finger = m_nodes.create(*first);
+			finger->m_parent = parent;
+			if (side < 0) {
+				parent->m_leftChild = finger;
+			} else {
+				parent->m_rightChild = finger;
+			}
+			++m_size;
+			retraceGrown(finger, m_root);
+		}
+		return m_size - before;
+	}
+
+	// Takes the children from the node, they become detached subtrees
+	static std::pair<Node *, Node *> takeChildren(Node *n) {
+		Node *left = n->m_leftChild;
+		Node *right = n->m_rightChild;
+		if (left) {
+			left->m_parent = nullptr;
+		}
+		if (right) {
+			right->m_parent = nullptr;
+		}
+		n->m_leftChild = n->m_rightChild = nullptr;
+		return {left, right};
+	}
+
+	// Joins the detached subtrees left and right of the given heights with the node middle between them: the values
+	// of left are less than the value of middle and those of right greater. Returns the root of the joined subtree and
+	// sets height to its levels, in O(difference of heights).
+	Node *join(Node *left, size_t leftHeight, Node *middle, Node *right, size_t rightHeight, size_t &height) {
+		if (leftHeight <= rightHeight + 1 && rightHeight <= leftHeight + 1) {
+			middle->m_parent = nullptr;
+			middle->m_leftChild = left;
+			middle->m_rightChild = right;
+			if (left) {
+				left->m_parent = middle;
+			}
+			if (right) {
+				right->m_parent = middle;
+			}
+			middle->m_balance = rightHeight - leftHeight;
+			middle->updateData();
+			height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+			return middle;
+		}
+
+		// descend the inner side of the taller subtree to a node as high as the other subtree, or one level higher
+		// (it can be empty when the other subtree is)
+		bool leftTaller = leftHeight > rightHeight;
+		Node *joined = leftTaller ? left : right;
+		Node *other = leftTaller ? right : left;
+		size_t joinedHeight = leftTaller ? leftHeight : rightHeight;
+		size_t otherHeight = leftTaller ? rightHeight : leftHeight;
+		Node *parent = nullptr;
+		Node *visiting = joined;
+		size_t visitingHeight = joinedHeight;
+		while (visitingHeight > otherHeight + 1) {
+			parent = visiting;
+			visitingHeight = childHeight(visiting, visitingHeight, leftTaller ? 1 : -1);
+			visiting = leftTaller ? visiting->m_rightChild : visiting->m_leftChild;
+		}
+		middle->m_parent = parent;
+		middle->m_leftChild = leftTaller ? visiting : other;
+		middle->m_rightChild = leftTaller ? other : visiting;
+		if (visiting) {
+			visiting->m_parent = middle;
+		}
+		if (other) {
+			other->m_parent = middle;
+		}
+		if (leftTaller) {
+			parent->m_rightChild = middle;
+		} else {
+			parent->m_leftChild = middle;
+		}
+		middle->m_balance = leftTaller ? otherHeight - visitingHeight : visitingHeight - otherHeight;
+		middle->updateData();
+		// middle is one level higher than visiting was
+		height = joinedHeight + retraceGrown(middle, joined);
+		return joined;
+	}
+
+	Node *join(Node *left, Node *middle, Node *right) {
+		size_t height;
+		return join(left, heightOf(left), middle, right, heightOf(right), height);
+	}
+
+	// Joins the detached subtrees without a node between them, the last node of left is moved between them
+	Node *join(Node *left, Node *right) {
+		if (!left) {
+			return right;
+		}
+		Node *last;
+		size_t restHeight, height;
+		Node *rest = splitLast(left, heightOf(left), last, restHeight);
+		return join(rest, restHeight, last, right, heightOf(right), height);
+	}
+
+	// Takes the last node from the detached subtree of the height, returns the rest and sets restHeight to its levels
+	Node *splitLast(Node *n, size_t height, Node *&last, size_t &restHeight) {
+		size_t leftHeight = childHeight(n, height, -1);
+		size_t rightHeight = childHeight(n, height, 1);
+		auto children = takeChildren(n);
+		if (!children.second) {
+			last = n;
+			restHeight = leftHeight;
+			return children.first;
+		}
+		size_t rightRestHeight;
+		Node *rest = splitLast(children.second, rightHeight, last, rightRestHeight);
+		return join(children.first, leftHeight, n, rest, rightRestHeight, restHeight);
+	}
+
+	struct Split {
+		Node *m_less;
+		// the node with the key, if there is one
+		Node *m_equal;
+		Node *m_greater;
+		size_t m_lessHeight;
+		size_t m_greaterHeight;
+	};
+
+	// Splits the detached subtree of the height into the values less than the key, the value equal to it and those
+	// greater, in O(log n)
+	template <typename K>
+	Split split(Node *n, size_t height, const K &key) {
+		if (!n) {
+			return {nullptr, nullptr, nullptr, 0, 0};
+		}
+		size_t leftHeight = childHeight(n, height, -1);
+		size_t rightHeight = childHeight(n, height, 1);
+		auto children = takeChildren(n);
+		int side = compare(key, n);
+		if (side == 0) {
+			n->m_balance = 0;
+			n->updateData();
+			return {children.first, n, children.second, leftHeight, rightHeight};
+		}
+		if (side < 0) {
+			Split parts = split(children.first, leftHeight, key);
+			parts.m_greater = join(parts.m_greater, parts.m_greaterHeight, n, children.second, rightHeight,
+								   parts.m_greaterHeight);
+			return parts;
+		}
+		Split parts = split(children.second, rightHeight, key);
+		parts.m_less = join(children.first, leftHeight, n, parts.m_less, parts.m_lessHeight, parts.m_lessHeight);
+		return parts;
+	}
+
+	template <typename K>
+	Split split(Node *n, const K &key) {
+		return split(n, heightOf(n), key);
+	}
+
+	// Nodes that the set operations leave out. The free list of the slabs is not thread safe, so their nodes
+	// are destroyed after the parallel part, other nodes right away. The kept nodes are linked by their parent pointers.
+	struct Dropped {
+		Node *m_first = nullptr;
+		Node *m_last = nullptr;
+		size_t m_count = 0;
+
+		void push(Node *n) {
+			n->m_parent = m_first;
+			m_first = n;
+			if (!m_last) {
+				m_last = n;
+			}
+		}
+
+		void merge(Dropped &other) {
+			if (other.m_first) {
+				other.m_last->m_parent = m_first;
+				m_first = other.m_first;
+				if (!m_last) {
+					m_last = other.m_last;
+				}
+			}
+			m_count += other.m_count;
+		}
+	};
+
+	void drop(Node *n, Dropped &dropped) {
+		++dropped.m_count;
+		if constexpr (decltype(m_nodes)::BULK_RELEASE) {
+			dropped.push(n);
+		} else {
+			m_nodes.destroy(n);
+		}
+	}
+
+	void dropSubtree(Node *n, Dropped &dropped) {
+		dismantle(n, [&](Node *visiting) { drop(visiting, dropped); });
+	}
+
+	// Subtrees lower than this are not worth a thread
+	static constexpr size_t PARALLEL_HEIGHT = 14;
+
+	// Runs the two calls on two threads if there are threads for both, the first one gets half of them.
+	// There are no threads on Progtest, the calls always run one after the other there.
+	template <typename First, typename Second>
+	static void fork([[maybe_unused]] unsigned threads, [[maybe_unused]] size_t height, First &&first, Second &&second) {
+#ifndef __PROGTEST__
+		if (threads >= 2 && height >= PARALLEL_HEIGHT) {
+			std::thread thread(first);
+			second();
+			thread.join();
+			return;
+		}
+#endif
+		first();
+		second();
+	}
+
+	// Threads of the set operations unless told otherwise
+	static unsigned defaultThreads() {
+#ifndef __PROGTEST__
+		return std::thread::hardware_concurrency();
+#else
+		return 1;
+#endif
+	}
+
+	// The set operations of the detached subtrees a and b. The recursion splits b by the root of a
+	// and forks on the halves, so that they run in O(m log(n / m + 1)) work and O(log n log m) span.
+	Node *unite(Node *a, Node *b, Dropped &dropped, unsigned threads) {
+		if (!a) {
+			return b;
+		}
+		if (!b) {
+			return a;
+		}
+		Split parts = split(b, a->m_value);
+		if (parts.m_equal) {
+			drop(parts.m_equal, dropped);
+		}
+		auto children = takeChildren(a);
+		Node *left, *right;
+		Dropped rightDropped;
+		size_t leftHeight = heightOf(children.first);
+		fork(threads, leftHeight > parts.m_lessHeight ? leftHeight : parts.m_lessHeight,
+			 [&]() { left = unite(children.first, parts.m_less, dropped, threads / 2); },
+			 [&]() { right = unite(children.second, parts.m_greater, rightDropped, threads - threads / 2); });
+		dropped.merge(rightDropped);
+		return join(left, a, right);
+	}
+
+	Node *intersect(Node *a, Node *b, Dropped &dropped, unsigned threads) {
+		if (!a || !b) {
+			dropSubtree(a, dropped);
+			dropSubtree(b, dropped);
+			return nullptr;
+		}
+		Split parts = split(b, a->m_value);
+		auto children = takeChildren(a);
+		Node *left, *right;
+		Dropped rightDropped;
+		size_t leftHeight = heightOf(children.first);
+		fork(threads, leftHeight > parts.m_lessHeight ? leftHeight : parts.m_lessHeight,
+			 [&]() { left = intersect(children.first, parts.m_less, dropped, threads / 2); },
+			 [&]() { right = intersect(children.second, parts.m_greater, rightDropped, threads - threads / 2); });
+		dropped.merge(rightDropped);
+		if (parts.m_equal) {
+			drop(parts.m_equal, dropped);
+			return join(left, a, right);
+		}
+		drop(a, dropped);
+		return join(left, right);
+	}
+
+	Node *subtract(Node *a, Node *b, Dropped &dropped, unsigned threads) {
+		if (!a || !b) {
+			dropSubtree(b, dropped);
+			return a;
+		}
+		Split parts = split(b, a->m_value);
+		auto children = takeChildren(a);
+		Node *left, *right;
+		Dropped rightDropped;
+		size_t leftHeight = heightOf(children.first);
+		fork(threads, leftHeight > parts.m_lessHeight ? leftHeight : parts.m_lessHeight,
+			 [&]() { left = subtract(children.first, parts.m_less, dropped, threads / 2); },
+			 [&]() { right = subtract(children.second, parts.m_greater, rightDropped, threads - threads / 2); });
+		dropped.merge(rightDropped);
+		if (parts.m_equal) {
+			drop(parts.m_equal, dropped);
+			drop(a, dropped);
+			return join(left, right);
+		}
+		return join(left, a, right);
+	}
+
+	// Runs the set operation on the nodes of both trees, the result takes the nodes and the pools of both
+	template <typename Operation>
+	static Tree combine(Tree &&a, Tree &&b, Operation operation) {
+		Tree result(std::move(a));
+		result.m_nodes.adopt(b.m_nodes);
+		size_t size = result.m_size + b.m_size;
+		Node *other = b.m_root;
+		b.m_root = nullptr;
+		b.m_size = 0;
+		Dropped dropped;
+		result.m_root = operation(result, result.m_root, other, dropped);
+		for (Node *n = dropped.m_first; n;) {
+			Node *next = n->m_parent;
+			result.m_nodes.destroy(n);
+			n = next;
+		}
+		result.m_size = size - dropped.m_count;
+		return result;
+	}
+
+	// Joins the trees with the value between them, the values of left have to be less than it and those of right greater
+	static Tree join(Tree &&left, T middle, Tree &&right) {
+		Tree result(std::move(left));
+		result.m_nodes.adopt(right.m_nodes);
+		Node *n = result.m_nodes.create(std::move(middle));
+		result.m_root = result.join(result.m_root, n, right.m_root);
+		result.m_size += right.m_size + 1;
+		right.m_root = nullptr;
+		right.m_size = 0;
+		return result;
+	}
+
+	// The set operations take the nodes of both trees, on up to threads threads.
+	// The values of a are kept, those of b only where a does not have them.
+	static Tree set_union(Tree &&a, Tree &&b, unsigned threads = defaultThreads()) {
+		return combine(std::move(a), std::move(b), [threads](Tree &tree, Node *x, Node *y, Dropped &dropped) {
+			return tree.unite(x, y, dropped, threads);
+		});
+	}
+
+	static Tree set_intersection(Tree &&a, Tree &&b, unsigned threads = defaultThreads()) {
+		return combine(std::move(a), std::move(b), [threads](Tree &tree, Node *x, Node *y, Dropped &dropped) {
+			return tree.intersect(x, y, dropped, threads);
+		});
+	}
+
+	static Tree set_difference(Tree &&a, Tree &&b, unsigned threads = defaultThreads()) {
+		return combine(std::move(a), std::move(b), [threads](Tree &tree, Node *x, Node *y, Dropped &dropped) {
+			return tree.subtract(x, y, dropped, threads);
+		});
+	}
+
+	explicit Tree(const Compare &compare = Compare()) : m_compare(compare) {
+		m_root = nullptr;
+		m_size = 0;
+	}
+	Tree(const Tree &) = delete;
+	Tree &operator=(const Tree &) = delete;
+
+	Tree(Tree &&other) : m_root(other.m_root), m_size(other.m_size), m_compare(std::move(other.m_compare)),
+						 m_nodes(std::move(other.m_nodes)) {
+		other.m_root = nullptr;
+		other.m_size = 0;
+		other.m_nodes = {};
+	}
+
+	Tree &operator=(Tree &&other) {
+		if (this != &other) {
+			clear();
+			m_root = other.m_root;
+			m_size = other.m_size;
+			other.m_root = nullptr;
+			other.m_size = 0;
+			m_compare = std::move(other.m_compare);
+			m_nodes = std::move(other.m_nodes);
+			other.m_nodes = {};
+		}
+		return *this;
+	}
+
+	// Passes all the nodes of the subtree to destroy, which may free them.
+	// It rotates the left children up until the node has none, then it can go, no recursion or stack is needed.
+	template <typename Destroy>
+	static void dismantle(Node *visiting, Destroy &&destroy) {
+		while (visiting) {
+			Node *left = visiting->m_leftChild;
+			if (left) {
+				visiting->m_leftChild = left->m_rightChild;
+				left->m_rightChild = visiting;
+				visiting = left;
+			} else {
+				Node *right = visiting->m_rightChild;
+				destroy(visiting);
+				visiting = right;
+			}
+		}
+	}
+
+	void clear() {
+		// the values of trivially destructible types need no destruction, when the pool can free all the nodes at once
+		if constexpr (!(decltype(m_nodes)::BULK_RELEASE && std::is_trivially_destructible_v<T>)) {
+			dismantle(m_root, [this](Node *visiting) { m_nodes.destroy(visiting); });
+		}
+		m_nodes.release();
+		m_root = nullptr;
+		m_size = 0;
+	}
+
+	~Tree() {
+		clear();
+	}
+
+	// Needed to test the structure of the tree.
+	struct TesterInterface {
+		static const Node *root(const Tree *t) { return t->m_root; }
+		// Parent of root must be nullptr
+		static const Node *parent(const Node *n) { return n->m_parent; }
+		static const Node *right(const Node *n) { return n->m_rightChild; }
+		static const Node *left(const Node *n) { return n->m_leftChild; }
+		static const T &value(const Node *n) { return n->m_value; }
+		static int balance(const Node *n) { return n->m_balance; }
+	};
+};
+
+// Ordered set for many concurrent readers and some writers, after the concurrent AVL tree of Bronson et al.
+// find takes no locks, it descends optimistically and validates every step by the versions of the nodes, which change
+// when a rotation shrinks their subtree. Writers lock only the nodes they change, parents before children, and repair
+// the heights and the balance on the way up afterwards, so the tree may be out of balance while they run.
+// An erased value whose node has two children stays in it as a routing node until the node can be unlinked.
+// Unlinked nodes are freed by epochs: every operation announces the global epoch it started in, and a node unlinked
+// in epoch e is freed once the global epoch reaches e + 2, which it can only do after every operation which might
+// still walk the node has finished. find returns a copy of the value, because the node may be freed right after it.
+// The tree needs threads, so it is not built on Progtest.
+#ifndef __PROGTEST__
+template <typename T, typename Compare = std::less<T>>
+struct ConcurrentTree {
+	static constexpr uint64_t UNLINKED = 1;
+	static constexpr uint64_t SHRINKING = 2;
+	static constexpr uint64_t SHRINK_COUNT = 4;
+	// epoch of the operations which are not running
+	static constexpr uint64_t IDLE = 0;
+	// unlinked nodes from which they are freed
+	static constexpr size_t RECLAIM_BATCH = 64;
+
+	struct Node {
+		std::atomic<Node *> m_parent{nullptr};
+		std::atomic<Node *> m_leftChild{nullptr};
+		std::atomic<Node *> m_rightChild{nullptr};
+		std::atomic<uint64_t> m_version{0};
+		// levels of the subtree, as far as the node knows
+		std::atomic<int> m_height{1};
+		// false in a routing node
+		std::atomic<bool> m_present{true};
+		std::atomic<bool> m_locked{false};
+		// next unlinked node, and the epoch it was unlinked in
+		Node *m_retired = nullptr;
+		uint64_t m_retiredEpoch = 0;
+		// the holder of the root has no value
+		alignas(T) unsigned char m_storage[sizeof(T)];
+
+		const T &value() const {
+			return *std::launder(reinterpret_cast<const T *>(m_storage));
+		}
+
+		std::atomic<Node *> &child(int side) {
+			return side < 0 ? m_leftChild : m_rightChild;
+		}
+
+		void lock() {
+			while (m_locked.exchange(true, std::memory_order_acquire)) {
+				while (m_locked.load(std::memory_order_relaxed)) {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		void unlock() {
+			m_locked.store(false, std::memory_order_release);
+		}
+	};
+
+	struct Locked {
+		Node *m_node;
+		explicit Locked(Node *n) : m_node(n) { n->lock(); }
+		~Locked() { m_node->unlock(); }
+		Locked(const Locked &) = delete;
+		Locked &operator=(const Locked &) = delete;
+	};
+
+	// The epoch announced by one running operation. Records are taken for one operation and given back,
+	// there are as many of them as operations have ever run at once, they are freed with the tree.
+	struct EpochRecord {
+		std::atomic<uint64_t> m_epoch{IDLE};
+		std::atomic<bool> m_taken{false};
+		EpochRecord *m_next = nullptr;
+	};
+
+	// Announces the epoch for the whole operation, afterwards it frees the unlinked nodes if there are enough of them
+	struct Pinned {
+		const ConcurrentTree &m_tree;
+		EpochRecord *m_record;
+		explicit Pinned(const ConcurrentTree &tree) : m_tree(tree), m_record(tree.pin()) {}
+		~Pinned() {
+			m_record->m_epoch = IDLE;
+			m_record->m_taken.store(false, std::memory_order_release);
+			if (m_tree.m_retiredCount.load(std::memory_order_relaxed) >= RECLAIM_BATCH) {
+				const_cast<ConcurrentTree &>(m_tree).reclaim();
+			}
+		}
+		Pinned(const Pinned &) = delete;
+		Pinned &operator=(const Pinned &) = delete;
+	};
+
+	enum class Result { RETRY, NO, YES };
+
+	// what a node needs, or its new height
+	static constexpr int UNLINK_REQUIRED = -1;
+	static constexpr int REBALANCE_REQUIRED = -2;
+	static constexpr int NOTHING_REQUIRED = -3;
+
+	// the root is its right child, it is never changed itself
+	Node m_holder;
+	std::atomic<size_t> m_size{0};
+	std::atomic<Node *> m_retired{nullptr};
+	std::atomic<size_t> m_retiredCount{0};
+	// find changes only the epochs
+	mutable std::atomic<uint64_t> m_epoch{1};
+	mutable std::atomic<EpochRecord *> m_records{nullptr};
+	std::atomic<bool> m_reclaiming{false};
+	Compare m_compare;
+
+	// Takes a free record, or adds a new one, and announces the current epoch in it.
+	// The epoch is read again after it is announced, so that it cannot have moved on unnoticed in between.
+	EpochRecord *pin() const {
+		EpochRecord *record = m_records.load();
+		while (record && (record->m_taken.load(std::memory_order_relaxed) || record->m_taken.exchange(true))) {
+			record = record->m_next;
+		}
+		if (!record) {
+			record = new EpochRecord();
+			record->m_taken = true;
+			record->m_next = m_records.load();
+			while (!m_records.compare_exchange_weak(record->m_next, record)) {
+			}
+		}
+		uint64_t epoch = m_epoch.load();
+		while (true) {
+			record->m_epoch = epoch;
+			uint64_t current = m_epoch.load();
+			if (current == epoch) {
+				return record;
+			}
+			epoch = current;
+		}
+	}
+
+	// Moves to the next epoch if every running operation has started in the current one
+	void advance() {
+		uint64_t epoch = m_epoch.load();
+		for (EpochRecord *record = m_records.load(); record; record = record->m_next) {
+			uint64_t announced = record->m_epoch.load();
+			if (announced != IDLE && announced != epoch) {
+				return;
+			}
+		}
+		m_epoch.compare_exchange_strong(epoch, epoch + 1);
+	}
+
+	// Frees the unlinked nodes which no operation can reach any more, one thread at a time
+	void reclaim() {
+		if (m_reclaiming.exchange(true, std::memory_order_acquire)) {
+			return;
+		}
+		advance();
+		uint64_t epoch = m_epoch.load();
+		Node *kept = nullptr;
+		Node *lastKept = nullptr;
+		size_t freed = 0;
+		for (Node *n = m_retired.exchange(nullptr); n;) {
+			Node *next = n->m_retired;
+			if (n->m_retiredEpoch + 2 <= epoch) {
+				destroy(n);
+				freed++;
+			} else {
+				n->m_retired = kept;
+				kept = n;
+				lastKept = lastKept ? lastKept : n;
+			}
+			n = next;
+		}
+		if (kept) {
+			lastKept->m_retired = m_retired.load();
+			while (!m_retired.compare_exchange_weak(lastKept->m_retired, kept)) {
+			}
+		}
+		m_retiredCount -= freed;
+		m_reclaiming.store(false, std::memory_order_release);
+	}
+
+	static bool isShrinkingOrUnlinked(uint64_t version) {
+		return version & (SHRINKING | UNLINKED);
+	}
+
+	static bool isUnlinked(uint64_t version) {
+		return version & UNLINKED;
+	}
+
+	static void waitUntilShrinkCompleted(Node *n, uint64_t version) {
+		if (!(version & SHRINKING)) {
+			return;
+		}
+		while (n->m_version.load() == version) {
+			std::this_thread::yield();
+		}
+	}
+
+	static int height(Node *n) {
+		return n ? n->m_height.load() : 0;
+	}
+
+	int compare(const T &key, const Node *n) const {
+		if (m_compare(key, n->value())) {
+			return -1;
+		}
+		return m_compare(n->value(), key) ? 1 : 0;
+	}
+
+	Result attemptFind(const T &key, Node *n, int side, uint64_t version, const T *&found) const {
+		while (true) {
+			Node *child = n->child(side).load();
+			if (!child) {
+				return n->m_version.load() != version ? Result::RETRY : Result::NO;
+			}
+			int childSide = compare(key, child);
+			if (childSide == 0) {
+				// how it got here does not matter, it was in the tree
+				if (!child->m_present.load()) {
+					return Result::NO;
+				}
+				found = &child->value();
+				return Result::YES;
+			}
+			uint64_t childVersion = child->m_version.load();
+			if (isShrinkingOrUnlinked(childVersion)) {
+				waitUntilShrinkCompleted(child, childVersion);
+			} else if (child == n->child(side).load()) {
+				// the child is valid if the node still is
+				if (n->m_version.load() != version) {
+					return Result::RETRY;
+				}
+				Result result = attemptFind(key, child, childSide, childVersion, found);
+				if (result != Result::RETRY) {
+					return result;
+				}
+				continue;
+			}
+			if (n->m_version.load() != version) {
+				return Result::RETRY;
+			}
+		}
+	}
+
+	std::optional<T> find(const T &value) const {
+		Pinned pinned(*this);
+		const T *found = nullptr;
+		Node *holder = const_cast<Node *>(&m_holder);
+		while (attemptFind(value, holder, 1, 0, found) == Result::RETRY) {
+		}
+		if (!found) {
+			return std::nullopt;
+		}
+		return *found;
+	}
+
+	size_t size() const {
+		return m_size.load();
+	}
+
+	Result attemptInsert(const T &value, Node *n, int side, uint64_t version) {
+		while (true) {
+			Node *child = n->child(side).load();
+			if (n->m_version.load() != version) {
+				return Result::RETRY;
+			}
+			if (!child) {
+				Node *damaged;
+				{
+					Locked lock(n);
+					// with the lock no rotation can move the place any more
+					if (n->m_version.load() != version) {
+						return Result::RETRY;
+					}
+					if (n->child(side).load()) {
+						// lost a race with another insert
+						continue;
+					}
+					Node *leaf = new Node();
+					new (leaf->m_storage) T(value);
+					leaf->m_parent = n;
+					n->child(side) = leaf;
+					damaged = fixHeight(n);
+				}
+				fixHeightAndRebalance(damaged);
+				return Result::YES;
+			}
+			int childSide = compare(value, child);
+			uint64_t childVersion = child->m_version.load();
+			if (isShrinkingOrUnlinked(childVersion)) {
+				waitUntilShrinkCompleted(child, childVersion);
+				continue;
+			}
+			if (child != n->child(side).load()) {
+				continue;
+			}
+			if (n->m_version.load() != version) {
+				return Result::RETRY;
+			}
+			Result result = childSide == 0 ? attemptRevive(child) : attemptInsert(value, child, childSide, childVersion);
+			if (result != Result::RETRY) {
+				return result;
+			}
+		}
+	}
+
+	// The value is inserted back to its routing node
+	Result attemptRevive(Node *n) {
+		Locked lock(n);
+		if (isUnlinked(n->m_version.load())) {
+			return Result::RETRY;
+		}
+		if (n->m_present.load()) {
+			return Result::NO;
+		}
+		n->m_present = true;
+		return Result::YES;
+	}
+
+	bool insert(const T &value) {
+		Pinned pinned(*this);
+		Result result;
+		while ((result = attemptInsert(value, &m_holder, 1, 0)) == Result::RETRY) {
+		}
+		if (result == Result::YES) {
+			++m_size;
+		}
+		return result == Result::YES;
+	}
+
+	Result attemptErase(const T &value, Node *n, int side, uint64_t version) {
+		while (true) {
+			Node *child = n->child(side).load();
+			if (n->m_version.load() != version) {
+				return Result::RETRY;
+			}
+			if (!child) {
+				return Result::NO;
+			}
+			int childSide = compare(value, child);
+			uint64_t childVersion = child->m_version.load();
+			if (isShrinkingOrUnlinked(childVersion)) {
+				waitUntilShrinkCompleted(child, childVersion);
+				continue;
+			}
+			if (child != n->child(side).load()) {
+				continue;
+			}
+			if (n->m_version.load() != version) {
+				return Result::RETRY;
+			}
+			Result result = childSide == 0 ? attemptEraseNode(n, child) : attemptErase(value, child, childSide, childVersion);
+			if (result != Result::RETRY) {
+				return result;
+			}
+		}
+	}
+
+	Result attemptEraseNode(Node *parent, Node *n) {
+		if (!n->m_present.load()) {
+			return Result::NO;
+		}
+		if (!n->m_leftChild.load() || !n->m_rightChild.load()) {
+			// the node can probably be unlinked, that needs the lock of the parent first
+			Node *damaged;
+			{
+				Locked lockParent(parent);
+				if (isUnlinked(parent->m_version.load()) || n->m_parent.load() != parent) {
+					return Result::RETRY;
+				}
+				{
+					Locked lock(n);
+					if (!n->m_present.load()) {
+						return Result::NO;
+					}
+					if (!attemptUnlink(parent, n)) {
+						return Result::RETRY;
+					}
+				}
+				damaged = fixHeight(parent);
+			}
+			fixHeightAndRebalance(damaged);
+			return Result::YES;
+		}
+		Locked lock(n);
+		if (isUnlinked(n->m_version.load())) {
+			return Result::RETRY;
+		}
+		if (!n->m_present.load()) {
+			return Result::NO;
+		}
+		if (!n->m_leftChild.load() || !n->m_rightChild.load()) {
+			return Result::RETRY;
+		}
+		n->m_present = false;
+		return Result::YES;
+	}
+
+	bool erase(const T &value) {
+		Pinned pinned(*this);
+		Result result;
+		while ((result = attemptErase(value, &m_holder, 1, 0)) == Result::RETRY) {
+		}
+		if (result == Result::YES) {
+			--m_size;
+		}
+		return result == Result::YES;
+	}
+
+	// The methods below need the locks of the nodes they change
+
+	// Unlinks the node with at most one child, false if it has two or is not the child of the parent any more
+	bool attemptUnlink(Node *parent, Node *n) {
+		Node *parentLeft = parent->m_leftChild.load();
+		Node *parentRight = parent->m_rightChild.load();
+		if (parentLeft != n && parentRight != n) {
+			return false;
+		}
+		Node *left = n->m_leftChild.load();
+		Node *right = n->m_rightChild.load();
+		if (left && right) {
+			return false;
+		}
+		Node *splice = left ? left : right;
+		if (parentLeft == n) {
+			parent->m_leftChild = splice;
+		} else {
+			parent->m_rightChild = splice;
+		}
+		if (splice) {
+			splice->m_parent = parent;
+		}
+		n->m_version = UNLINKED;
+		n->m_present = false;
+		// operations which start from now on cannot reach the node
+		n->m_retiredEpoch = m_epoch.load();
+		n->m_retired = m_retired.load();
+		while (!m_retired.compare_exchange_weak(n->m_retired, n)) {
+		}
+		m_retiredCount++;
+		return true;
+	}
+
+	int nodeCondition(Node *n) {
+		Node *left = n->m_leftChild.load();
+		Node *right = n->m_rightChild.load();
+		if ((!left || !right) && !n->m_present.load()) {
+			return UNLINK_REQUIRED;
+		}
+		int heightN = n->m_height.load();
+		int heightLeft = height(left);
+		int heightRight = height(right);
+		int newHeight = 1 + std::max(heightLeft, heightRight);
+		int balance = heightLeft - heightRight;
+		if (balance < -1 || balance > 1) {
+			return REBALANCE_REQUIRED;
+		}
+		return heightN != newHeight ? newHeight : NOTHING_REQUIRED;
+	}
+
+	// Fixes the height of the node, returns the next node that may need a repair
+	Node *fixHeight(Node *n) {
+		int condition = nodeCondition(n);
+		switch (condition) {
+			case REBALANCE_REQUIRED:
+			case UNLINK_REQUIRED:
+				return n;
+			case NOTHING_REQUIRED:
+				return nullptr;
+			default:
+				n->m_height = condition;
+				return n->m_parent.load();
+		}
+	}
+
+	// Repairs the nodes from n up while they need it. A rotation may leave a node below damaged, the parent of the
+	// rotation is then checked again once the repairs below it are done.
+	void fixHeightAndRebalance(Node *n) {
+		std::vector<Node *> rotated;
+		while (true) {
+			if (!n || !n->m_parent.load()) {
+				if (rotated.empty()) {
+					return;
+				}
+				n = rotated.back();
+				rotated.pop_back();
+				continue;
+			}
+			int condition = nodeCondition(n);
+			if (condition == NOTHING_REQUIRED || isUnlinked(n->m_version.load())) {
+				n = nullptr;
+				continue;
+			}
+			if (condition != UNLINK_REQUIRED && condition != REBALANCE_REQUIRED) {
+				Locked lock(n);
+				n = fixHeight(n);
+				continue;
+			}
+			Node *parent = n->m_parent.load();
+			Locked lockParent(parent);
+			if (!isUnlinked(parent->m_version.load()) && n->m_parent.load() == parent) {
+				Locked lock(n);
+				Node *damaged = rebalance(parent, n);
+				if (condition == REBALANCE_REQUIRED && damaged != parent->m_parent.load() &&
+					(rotated.empty() || rotated.back() != parent)) {
+					rotated.push_back(parent);
+				}
+				n = damaged;
+			}
+		}
+	}
+
+	Node *rebalance(Node *parent, Node *n) {
+		Node *left = n->m_leftChild.load();
+		Node *right = n->m_rightChild.load();
+		if ((!left || !right) && !n->m_present.load()) {
+			return attemptUnlink(parent, n) ? fixHeight(parent) : n;
+		}
+		int heightN = n->m_height.load();
+		int heightLeft = height(left);
+		int heightRight = height(right);
+		int newHeight = 1 + std::max(heightLeft, heightRight);
+		int balance = heightLeft - heightRight;
+		if (balance > 1) {
+			return rebalanceTo(parent, n, -1, left, heightRight);
+		}
+		if (balance < -1) {
+			return rebalanceTo(parent, n, 1, right, heightLeft);
+		}
+		if (newHeight != heightN) {
+			n->m_height = newHeight;
+			return fixHeight(parent);
+		}
+		return nullptr;
+	}
+
+	// Rotates the child on the side up, which is too high compared to the other child of height otherHeight
+	Node *rebalanceTo(Node *parent, Node *n, int side, Node *child, int otherHeight) {
+		Locked lockChild(child);
+		if (child->m_height.load() - otherHeight <= 1) {
+			return n;
+		}
+		Node *inner = child->child(-side).load();
+		int outerHeight = height(child->child(side).load());
+		int innerHeight = height(inner);
+		if (outerHeight >= innerHeight) {
+			return rotate(parent, n, side, child, otherHeight, outerHeight, inner, innerHeight);
+		}
+		{
+			Locked lockInner(inner);
+			innerHeight = inner->m_height.load();
+			if (outerHeight >= innerHeight) {
+				return rotate(parent, n, side, child, otherHeight, outerHeight, inner, innerHeight);
+			}
+			int innerOuterHeight = height(inner->child(side).load());
+			int balance = outerHeight - innerOuterHeight;
+			if (balance >= -1 && balance <= 1) {
+				return rotateTwice(parent, n, side, child, otherHeight, outerHeight, inner, innerOuterHeight);
+			}
+		}
+		// the inner grandchild is too high, the child has to be rotated the other way first
+		return rebalanceTo(n, child, -side, inner, outerHeight);
+	}
+
+	// Rotates the child on the side up, n shrinks
+	Node *rotate(Node *parent, Node *n, int side, Node *child, int otherHeight, int outerHeight, Node *inner, int innerHeight) {
+		uint64_t version = n->m_version.load();
+		Node *parentLeft = parent->m_leftChild.load();
+		n->m_version = version | SHRINKING;
+
+		n->child(side) = inner;
+		if (inner) {
+			inner->m_parent = n;
+		}
+		child->child(-side) = n;
+		n->m_parent = child;
+		if (parentLeft == n) {
+			parent->m_leftChild = child;
+		} else {
+			parent->m_rightChild = child;
+		}
+		child->m_parent = parent;
+
+		int newHeight = 1 + std::max(innerHeight, otherHeight);
+		n->m_height = newHeight;
+		child->m_height = 1 + std::max(outerHeight, newHeight);
+		n->m_version = version + SHRINK_COUNT;
+
+		// repair what the locks allow, from the lowest node
+		int balance = innerHeight - otherHeight;
+		if (balance < -1 || balance > 1) {
+			return n;
+		}
+		if ((!inner || otherHeight == 0) && !n->m_present.load()) {
+			return n;
+		}
+		balance = outerHeight - newHeight;
+		if (balance < -1 || balance > 1) {
+			return child;
+		}
+		if (outerHeight == 0 && !child->m_present.load()) {
+			return child;
+		}
+		return fixHeight(parent);
+	}
+
+	// Rotates the inner grandchild up twice, n and the child shrink
+	Node *rotateTwice(Node *parent, Node *n, int side, Node *child, int otherHeight, int outerHeight, Node *inner,
+					  int innerOuterHeight) {
+		uint64_t version = n->m_version.load();
+		uint64_t childVersion = child->m_version.load();
+		Node *parentLeft = parent->m_leftChild.load();
+		Node *innerOuter = inner->child(side).load();
+		Node *innerInner = inner->child(-side).load();
+		int innerInnerHeight = height(innerInner);
+		n->m_version = version | SHRINKING;
+		child->m_version = childVersion | SHRINKING;
+
+		child->child(-side) = innerOuter;
+		if (innerOuter) {
+			innerOuter->m_parent = child;
+		}
+		inner->child(side) = child;
+		child->m_parent = inner;
+		n->child(side) = innerInner;
+		if (innerInner) {
+			innerInner->m_parent = n;
+		}
+		inner->child(-side) = n;
+		n->m_parent = inner;
+		if (parentLeft == n) {
+			parent->m_leftChild = inner;
+		} else {
+			parent->m_rightChild = inner;
+		}
+		inner->m_parent = parent;
+
+		int newHeight = 1 + std::max(innerInnerHeight, otherHeight);
+		n->m_height = newHeight;
+		int newChildHeight = 1 + std::max(outerHeight, innerOuterHeight);
+		child->m_height = newChildHeight;
+		inner->m_height = 1 + std::max(newChildHeight, newHeight);
+		n->m_version = version + SHRINK_COUNT;
+		child->m_version = childVersion + SHRINK_COUNT;
+
+		int balance = innerInnerHeight - otherHeight;
+		if (balance < -1 || balance > 1) {
+			return n;
+		}
+		if ((!innerInner || otherHeight == 0) && !n->m_present.load()) {
+			return n;
+		}
+		if ((!innerOuter || outerHeight == 0) && !child->m_present.load()) {
+			return child;
+		}
+		balance = newChildHeight - newHeight;
+		if (balance < -1 || balance > 1) {
+			return inner;
+		}
+		return fixHeight(parent);
+	}
+
+	explicit ConcurrentTree(const Compare &compare = Compare()) : m_compare(compare) {
+		m_holder.m_height = 0;
+	}
+	ConcurrentTree(const ConcurrentTree &) = delete;
+	ConcurrentTree &operator=(const ConcurrentTree &) = delete;
+
+	static void destroy(Node *n) {
+		n->value().~T();
+		delete n;
+	}
+
+	~ConcurrentTree() {
+		std::vector<Node *> stack;
+		if (Node *root = m_holder.m_rightChild.load()) {
+			stack.push_back(root);
+		}
+		while (!stack.empty()) {
+			Node *n = stack.back();
+			stack.pop_back();
+			if (Node *left = n->m_leftChild.load()) {
+				stack.push_back(left);
+			}
+			if (Node *right = n->m_rightChild.load()) {
+				stack.push_back(right);
+			}
+			destroy(n);
+		}
+		for (Node *n = m_retired.load(); n;) {
+			Node *next = n->m_retired;
+			destroy(n);
+			n = next;
+		}
+		for (EpochRecord *record = m_records.load(); record;) {
+			EpochRecord *next = record->m_next;
+			delete record;
+			record = next;
+		}
+	}
+};
+#endif
+
+// Ordered set with the interface of Tree kept in a B+-tree. Every node keeps its keys in LINES cache lines, the values
+// are only in the leaves, the inner nodes keep copies of some of them as separators, so a search reads a few whole lines per level instead of one node per comparison.
+// The separator keys[i] of an inner node is not less than any value below the child i and less than all values below
+// the child i + 1. For arithmetic T compared by std::less, the free slots of the keys are filled by the largest value,
+// so the search counts the smaller keys over the whole array in a plain loop without branches, which -O2 does not
+// vectorize. Other T are searched by binary search and have to be default constructible and copyable.
+// One line per node finds the fastest up to about 100k keys, but four lines insert, find and erase faster in bigger sets,
+// 1.66 / 1.47 / 1.36 M/s against 1.05 / 1.30 / 0.93 M/s with 10M keys in benchmark_btree, so they are the default.
+template <typename T, typename Compare = std::less<T>, size_t LINES = 4>
+struct BTree {
+	static constexpr size_t CACHE_LINE = 64;
+	static constexpr size_t KEYS = LINES * CACHE_LINE / sizeof(T) > 4 ? LINES * CACHE_LINE / sizeof(T) : 4;
+	// least number of keys in every node but the root
+	static constexpr size_t MIN_KEYS = (KEYS - 1) / 2;
+	static constexpr bool BRANCHLESS = std::is_arithmetic_v<T> && std::is_same_v<Compare, std::less<T>>;
+
+	// the value of the free slots of the keys of a branchless node
+	static T largest() {
+		if constexpr (std::numeric_limits<T>::has_infinity) {
+			return std::numeric_limits<T>::infinity();
+		} else {
+			return std::numeric_limits<T>::max();
+		}
+	}
+
+	static void fillLargest(T *first, T *last) {
+		for (; first != last; ++first) {
+			*first = largest();
+		}
+	}
+
+	// Moves the items first..last to the place starting at destination, which may overlap them if it is on the left
+	template <typename Item>
+	static void moveRange(Item *first, Item *last, Item *destination) {
+		for (; first != last; ++first, ++destination) {
+			*destination = std::move(*first);
+		}
+	}
+
+	// Moves the items first..last to the place ending at destinationLast, which may overlap them if it is on the right
+	template <typename Item>
+	static void moveRangeBackward(Item *first, Item *last, Item *destinationLast) {
+		while (last != first) {
+			*--destinationLast = std::move(*--last);
+		}
+	}
+
+	// a leaf
+	struct alignas(CACHE_LINE) Node {
+		T m_keys[KEYS];
+		size_t m_count = 0;
+
+		Node() {
+			if constexpr (BRANCHLESS) {
+				fillLargest(m_keys, m_keys + KEYS);
+			}
+		}
+
+		// Shrinks the node to the first count keys
+		void truncate(size_t count) {
+			if constexpr (BRANCHLESS) {
+				fillLargest(m_keys + count, m_keys + m_count);
+			}
+			m_count = count;
+		}
+	};
+
+	struct Inner : Node {
+		Node *m_children[KEYS + 1];
+	};
+
+	Node *m_root = nullptr;
+	// levels of inner nodes above the leaves
+	size_t m_height = 0;
+	size_t m_size = 0;
+	Compare m_compare;
+
+	static Inner *inner(Node *n) {
+		return static_cast<Inner *>(n);
+	}
+
+	// Number of keys of the node less than the key
+	size_t rankIn(const Node *n, const T &key) const {
+		if constexpr (BRANCHLESS) {
+			size_t rank = 0;
+			for (size_t i = 0; i < KEYS; i++) {
+				rank += n->m_keys[i] < key;
+			}
+			return rank;
+		} else {
+			size_t low = 0, high = n->m_count;
+			while (low < high) {
+				size_t middle = (low + high) / 2;
+				if (m_compare(n->m_keys[middle], key)) {
+					low = middle + 1;
+				} else {
+					high = middle;
+				}
+			}
+			return low;
+		}
+	}
+
+	bool found(const Node *n, size_t rank, const T &key) const {
+		return rank < n->m_count && !m_compare(key, n->m_keys[rank]);
+	}
+
+	const T *find(const T &value) const {
+		if (!m_root) {
+			return nullptr;
+		}
+		const Node *n = m_root;
+		for (size_t level = m_height; level > 0; level--) {
+			n = static_cast<const Inner *>(n)->m_children[rankIn(n, value)];
+		}
+		size_t rank = rankIn(n, value);
+		return found(n, rank, value) ? &n->m_keys[rank] : nullptr;
+	}
+
+	size_t size() const {
+		return m_size;
+	}
+
+	// Moves the keys from the position one place right and puts the key there, the node must not be full
+	template <typename U>
+	static void insertKey(Node *n, size_t position, U &&key) {
+		moveRangeBackward(n->m_keys + position, n->m_keys + n->m_count, n->m_keys + n->m_count + 1);
+		n->m_keys[position] = std::forward<U>(key);
+		n->m_count++;
+	}
+
+	static void eraseKey(Node *n, size_t position) {
+		moveRange(n->m_keys + position + 1, n->m_keys + n->m_count, n->m_keys + position);
+		n->truncate(n->m_count - 1);
+	}
+
+	struct Split {
+		T m_separator;
+		Node *m_right = nullptr;
+	};
+
+	// Inserts the value below the node, a full node is split to the node and split.m_right
+	template <typename U>
+	bool insertTo(Node *n, size_t level, U &&value, Split &split) {
+		size_t rank = rankIn(n, value);
+		if (level == 0) {
+			if (found(n, rank, value)) {
+				return false;
+			}
+			if (n->m_count < KEYS) {
+				insertKey(n, rank, std::forward<U>(value));
+				return true;
+			}
+			size_t middle = KEYS / 2;
+			Node *right = new Node();
+			moveRange(n->m_keys + middle, n->m_keys + KEYS, right->m_keys);
+			right->m_count = KEYS - middle;
+			n->truncate(middle);
+			split.m_separator = n->m_keys[middle - 1];
+			split.m_right = right;
+			if (rank < middle) {
+				insertKey(n, rank, std::forward<U>(value));
+			} else {
+				insertKey(right, rank - middle, std::forward<U>(value));
+			}
+			return true;
+		}
+
+		Split below;
+		if (!insertTo(inner(n)->m_children[rank], level - 1, std::forward<U>(value), below)) {
+			return false;
+		}
+		if (below.m_right) {
+			insertChild(n, rank, std::move(below), split);
+		}
+		return true;
+	}
+
+	// Adds the split child after the child on the position, a full node is split to the node and split.m_right
+	void insertChild(Node *n, size_t position, Split &&child, Split &split) {
+		Inner *target = inner(n);
+		if (n->m_count == KEYS) {
+			size_t middle = KEYS / 2;
+			Inner *right = new Inner();
+			moveRange(n->m_keys + middle + 1, n->m_keys + KEYS, right->m_keys);
+			moveRange(target->m_children + middle + 1, target->m_children + KEYS + 1, right->m_children);
+			right->m_count = KEYS - middle - 1;
+			split.m_separator = std::move(n->m_keys[middle]);
+			split.m_right = right;
+			n->truncate(middle);
+			if (position > middle) {
+				target = right;
+				position -= middle + 1;
+			}
+		}
+		moveRangeBackward(target->m_children + position + 1, target->m_children + target->m_count + 1,
+						  target->m_children + target->m_count + 2);
+		target->m_children[position + 1] = child.m_right;
+		insertKey(target, position, std::move(child.m_separator));
+	}
+
+	template <typename U>
+	bool insertValue(U &&value) {
+		if (!m_root) {
+			m_root = new Node();
+		}
+		Split split;
+		if (!insertTo(m_root, m_height, std::forward<U>(value), split)) {
+			return false;
+		}
+		if (split.m_right) {
+			Inner *root = new Inner();
+			root->m_children[0] = m_root;
+			root->m_children[1] = split.m_right;
+			insertKey(root, 0, std::move(split.m_separator));
+			m_root = root;
+			m_height++;
+		}
+		m_size++;
+		return true;
+	}
+
+	bool insert(const T &value) {
+		return insertValue(value);
+	}
+
+	bool insert(T &&value) {
+		return insertValue(std::move(value));
+	}
+
+	// Erases the value below the node, the children left with too few keys are refilled
+	bool eraseFrom(Node *n, size_t level, const T &value) {
+		size_t rank = rankIn(n, value);
+		if (level == 0) {
+			if (!found(n, rank, value)) {
+				return false;
+			}
+			eraseKey(n, rank);
+			return true;
+		}
+		if (!eraseFrom(inner(n)->m_children[rank], level - 1, value)) {
+			return false;
+		}
+		if (inner(n)->m_children[rank]->m_count < MIN_KEYS) {
+			refill(inner(n), rank, level - 1);
+		}
+		return true;
+	}
+
+	// Moves a key to the child from a sibling, or merges it with one
+	void refill(Inner *n, size_t position, size_t childLevel) {
+		if (position > 0 && n->m_children[position - 1]->m_count > MIN_KEYS) {
+			takeFromLeft(n, position, childLevel);
+		} else if (position < n->m_count && n->m_children[position + 1]->m_count > MIN_KEYS) {
+			takeFromRight(n, position, childLevel);
+		} else {
+			merge(n, position > 0 ? position - 1 : position, childLevel);
+		}
+	}
+
+	void takeFromLeft(Inner *n, size_t position, size_t childLevel) {
+		Node *left = n->m_children[position - 1];
+		Node *child = n->m_children[position];
+		T &separator = n->m_keys[position - 1];
+		size_t last = left->m_count - 1;
+		if (childLevel == 0) {
+			insertKey(child, 0, std::move(left->m_keys[last]));
+			left->truncate(last);
+			separator = left->m_keys[last - 1];
+			return;
 		}
-		return n;
+		Inner *innerChild = inner(child);
+		moveRangeBackward(innerChild->m_children, innerChild->m_children + child->m_count + 1,
+						  innerChild->m_children + child->m_count + 2);
+		innerChild->m_children[0] = inner(left)->m_children[last + 1];
+		insertKey(child, 0, std::move(separator));
+		separator = std::move(left->m_keys[last]);
+		left->truncate(last);
 	}
 
-	void eraseSubMethod(Node *toDelete, Node *subChild) {
-		// set toDelete's parent as parent of toDelete's only child (if it exists)
-		if (subChild) {
-			subChild->m_parent = toDelete->m_parent;
+	void takeFromRight(Inner *n, size_t position, size_t childLevel) {
+		Node *child = n->m_children[position];
+		Node *right = n->m_children[position + 1];
+		T &separator = n->m_keys[position];
+		if (childLevel == 0) {
+			insertKey(child, child->m_count, std::move(right->m_keys[0]));
+			separator = child->m_keys[child->m_count - 1];
+			eraseKey(right, 0);
+			return;
 		}
-		// if parent exists, set it's child as this child
-		if (toDelete->m_parent) {
-			if (toDelete->m_parent->m_leftChild == toDelete) {
-				toDelete->m_parent->m_leftChild = subChild;
-			} else {
-				toDelete->m_parent->m_rightChild = subChild;
-			}
-		} else { // parent doesn't exist - toDelete is root - set this child as root
-			m_root = subChild;
+		Inner *innerRight = inner(right);
+		inner(child)->m_children[child->m_count + 1] = innerRight->m_children[0];
+		insertKey(child, child->m_count, std::move(separator));
+		separator = std::move(right->m_keys[0]);
+		moveRange(innerRight->m_children + 1, innerRight->m_children + right->m_count + 1, innerRight->m_children);
+		eraseKey(right, 0);
+	}
+
+	// Moves the child after the position and the separator between them to the child on the position
+	void merge(Inner *n, size_t position, size_t childLevel) {
+		Node *left = n->m_children[position];
+		Node *right = n->m_children[position + 1];
+		if (childLevel == 0) {
+			moveRange(right->m_keys, right->m_keys + right->m_count, left->m_keys + left->m_count);
+			left->m_count += right->m_count;
+			delete right;
+		} else {
+			moveRange(inner(right)->m_children, inner(right)->m_children + right->m_count + 1,
+					  inner(left)->m_children + left->m_count + 1);
+			left->m_keys[left->m_count] = std::move(n->m_keys[position]);
+			moveRange(right->m_keys, right->m_keys + right->m_count, left->m_keys + left->m_count + 1);
+			left->m_count += right->m_count + 1;
+			delete inner(right);
 		}
+		moveRange(n->m_children + position + 2, n->m_children + n->m_count + 1, n->m_children + position + 1);
+		eraseKey(n, position);
 	}
 
 	bool erase(const T &value) {
-		Node *toDelete = findByValue(value);
-		// case 1 - this node is not in tree
-		if (!toDelete) {
+		if (!m_root || !eraseFrom(m_root, m_height, value)) {
 			return false;
 		}
-
-		if (toDelete->m_leftChild && toDelete->m_rightChild) {
-			// case 4 - this node has two children
-			Node *min = findMin(toDelete->m_rightChild);
-			toDelete->swapValues(*min);
-			toDelete = min;
-		}
-		// case 2 - this node is a leaf
-		if (!toDelete->m_leftChild && !toDelete->m_rightChild) {
-			eraseSubMethod(toDelete, nullptr);
-		}
-		// case 3 - this node has one child
-		// case 3.1 - the child is left
-		if (toDelete->m_leftChild && !toDelete->m_rightChild) {
-			eraseSubMethod(toDelete, toDelete->m_leftChild);
-		}
-		// case 3.2 - the child is right
-		if (!toDelete->m_leftChild && toDelete->m_rightChild) {
-			eraseSubMethod(toDelete, toDelete->m_rightChild);
+		if (m_height > 0 && m_root->m_count == 0) {
+			Inner *root = inner(m_root);
+			m_root = root->m_children[0];
+			delete root;
+			m_height--;
 		}
-
-		Node *balanceFrom = toDelete->m_parent;
-		// delete the node itself
-		delete toDelete;
-		--m_size;
-		balance(balanceFrom);
+		m_size--;
 		return true;
 	}
 
-	Tree() {
-		m_root = nullptr;
-		m_size = 0;
+	explicit BTree(const Compare &compare = Compare()) : m_compare(compare) {}
+
+	BTree(const BTree &) = delete;
+	BTree &operator=(const BTree &) = delete;
+
+	BTree(BTree &&other) noexcept
+		: m_root(other.m_root), m_height(other.m_height), m_size(other.m_size), m_compare(std::move(other.m_compare)) {
+		other.m_root = nullptr;
+		other.m_height = 0;
+		other.m_size = 0;
 	}
-	void recursiveDestruct(Node *toDelete) {
-		if (toDelete) {
-			recursiveDestruct(toDelete->m_leftChild);
-			recursiveDestruct(toDelete->m_rightChild);
-			delete toDelete;
-		}
+
+	BTree &operator=(BTree &&other) noexcept {
+		std::swap(m_root, other.m_root);
+		std::swap(m_height, other.m_height);
+		std::swap(m_size, other.m_size);
+		std::swap(m_compare, other.m_compare);
+		return *this;
 	}
-	~Tree() {
-		recursiveDestruct(m_root);
+
+	// The depth is logarithmic with a large base, so the recursion is short
+	static void destroy(Node *n, size_t level) {
+		if (level == 0) {
+			delete n;
+			return;
+		}
+		for (size_t i = 0; i <= n->m_count; i++) {
+			destroy(inner(n)->m_children[i], level - 1);
+		}
+		delete inner(n);
 	}
 
-	// Needed to test the structure of the tree.
-	struct TesterInterface {
-		static const Node *root(const Tree *t) { return t->m_root; }
-		// Parent of root must be nullptr
-		static const Node *parent(const Node *n) { return n->m_parent; }
-		static const Node *right(const Node *n) { return n->m_rightChild; }
-		static const Node *left(const Node *n) { return n->m_leftChild; }
-		static const T &value(const Node *n) { return n->m_value; }
-	};
+	~BTree() {
+		if (m_root) {
+			destroy(m_root, m_height);
+		}
+	}
 };
 
 #ifndef __PROGTEST__
 
+std::atomic<size_t> g_allocations = 0;
+
+[[gnu::noinline]] void *operator new(size_t size) {
+	++g_allocations;
+	if (void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, size_t) noexcept { std::free(p); }
+
 struct TestFailed : std::runtime_error {
 	using std::runtime_error::runtime_error;
 };
@@ -355,7 +2604,7 @@ std::string fmt(const char *f, ...) {
 	return buf;
 }
 
-template <typename T>
+template <typename T, typename TestedTree = Tree<T>>
 struct Tester {
 	Tester() = default;
 
@@ -398,6 +2647,62 @@ struct Tester {
 			check_tree();
 	}
 
+	void check_iteration() const {
+		auto t = tested.begin();
+		for (auto r = ref.begin(); r != ref.end(); ++r, ++t)
+			if (t == tested.end() || *t != *r)
+				throw TestFailed("Iteration: element mismatch.");
+		if (t != tested.end())
+			throw TestFailed("Iteration: too many elements.");
+
+		for (auto r = ref.end(); r != ref.begin();) {
+			--r;
+			--t;
+			if (*t != *r)
+				throw TestFailed("Backward iteration: element mismatch.");
+		}
+		if (t != tested.begin())
+			throw TestFailed("Backward iteration: too many elements.");
+	}
+
+	void bounds(const T &x) const {
+		auto check = [&](auto r, auto t, const char *name) {
+			bool end_r = r == ref.end();
+			bool end_t = t == tested.end();
+			if (end_r != end_t || (!end_r && *r != *t))
+				throw TestFailed(fmt("%s mismatch.", name));
+		};
+		check(ref.lower_bound(x), tested.lower_bound(x), "Lower bound");
+		check(ref.upper_bound(x), tested.upper_bound(x), "Upper bound");
+		auto range = tested.equal_range(x);
+		check(ref.lower_bound(x), range.first, "Equal range begin");
+		check(ref.upper_bound(x), range.second, "Equal range end");
+	}
+
+	void range(const T &from, const T &to) const {
+		std::vector<T> values;
+		tested.for_each_in_range(from, to, [&](const T &value) { values.push_back(value); });
+		auto r = ref.lower_bound(from);
+		for (const T &value : values) {
+			if (r == ref.end() || *r != value)
+				throw TestFailed("Range: element mismatch.");
+			++r;
+		}
+		if (r != ref.end() && *r < to)
+			throw TestFailed("Range: missing elements.");
+	}
+
+	// The values have to be sorted without duplicates
+	void insert_sorted_batch(const std::vector<T> &values) {
+		size_t inserted = 0;
+		for (const T &value : values)
+			inserted += ref.insert(value);
+		size_t inserted_t = tested.insert_sorted_batch(values.begin(), values.end());
+		if (inserted != inserted_t)
+			throw TestFailed(fmt("Sorted batch: inserted %zu but expected %zu.", inserted_t, inserted));
+		check_tree();
+	}
+
 	struct NodeCheckResult {
 		const T *min = nullptr;
 		const T *max = nullptr;
@@ -406,7 +2711,7 @@ struct Tester {
 	};
 
 	void check_tree() const {
-		using TI = typename Tree<T>::TesterInterface;
+		using TI = typename TestedTree::TesterInterface;
 		auto ref_it = ref.begin();
 		bool check_value_failed = false;
 		auto check_value = [&](const T &v) {
@@ -436,7 +2741,7 @@ struct Tester {
 		if (!n)
 			return {};
 
-		using TI = typename Tree<T>::TesterInterface;
+		using TI = typename TestedTree::TesterInterface;
 		if constexpr (config::PARENT_POINTERS) {
 			if (TI::parent(n) != p)
 				throw TestFailed("Parent mismatch.");
@@ -455,6 +2760,10 @@ struct Tester {
 			throw TestFailed(fmt(
 				"Tree is not avl balanced: left depth %i and right depth %i.",
 				l.depth, r.depth));
+		if (config::CHECK_DEPTH && TI::balance(n) != r.depth - l.depth)
+			throw TestFailed(fmt(
+				"Balance factor %i does not match left depth %i and right depth %i.",
+				TI::balance(n), l.depth, r.depth));
 
 		return {
 			l.min ? l.min : &TI::value(n),
@@ -466,7 +2775,7 @@ struct Tester {
 		throw TestFailed(fmt("%s: ref %s.", msg, s ? "succeeded" : "failed"));
 	}
 
-	Tree<T> tested;
+	TestedTree tested;
 	Ref<T> ref;
 };
 
@@ -522,8 +2831,9 @@ enum RandomTestFlags : unsigned {
 	CHECK_TREE = 4
 };
 
+template <typename TestedTree = Tree<size_t>>
 void test_random(size_t size, unsigned flags = 0) {
-	Tester<size_t> t;
+	Tester<size_t, TestedTree> t;
 	std::mt19937 my_rand(24707 + size);
 
 	bool seq = flags & SEQ;
@@ -554,7 +2864,1099 @@ void test_random(size_t size, unsigned flags = 0) {
 	t.check_tree();
 }
 
-int main() {
+// Keys longer than the small string buffer, so that every copy of one allocates
+std::string long_key(size_t i) {
+	return fmt("key-of-a-long-string-%020zu", i);
+}
+
+void test_heterogeneous() {
+	Tree<std::string, std::less<>> tree;
+	for (size_t i = 0; i < 1000; i += 2)
+		tree.insert(long_key(i));
+
+	std::vector<std::string> keys;
+	for (size_t i = 0; i < 1000; i++)
+		keys.push_back(long_key(i));
+
+	size_t before = g_allocations;
+	for (size_t i = 0; i < keys.size(); i++) {
+		std::string_view view = keys[i];
+		const std::string *found = tree.find(view);
+		if ((found != nullptr) != (i % 2 == 0) || (found && *found != view))
+			throw TestFailed(fmt("Heterogeneous find of %zu is wrong.", i));
+		if ((tree.find(keys[i].c_str()) != nullptr) != (i % 2 == 0))
+			throw TestFailed(fmt("Heterogeneous find of %zu as a C string is wrong.", i));
+	}
+	if (g_allocations != before)
+		throw TestFailed(fmt("Heterogeneous find allocated %zu times.", g_allocations - before));
+
+	// a lookup with the key type itself does not copy it either
+	Tree<std::string> plain;
+	for (size_t i = 0; i < 1000; i += 2)
+		plain.insert(keys[i]);
+	before = g_allocations;
+	for (size_t i = 0; i < keys.size(); i++)
+		if ((plain.find(keys[i]) != nullptr) != (i % 2 == 0))
+			throw TestFailed(fmt("Find of %zu is wrong.", i));
+	if (g_allocations != before)
+		throw TestFailed(fmt("Find allocated %zu times.", g_allocations - before));
+
+	// an insert of a key that is already there neither copies it nor allocates a node
+	before = g_allocations;
+	for (size_t i = 0; i < keys.size(); i += 2)
+		if (plain.insert(keys[i]))
+			throw TestFailed(fmt("Insert of the duplicate %zu succeeded.", i));
+	if (g_allocations != before)
+		throw TestFailed(fmt("Duplicate inserts allocated %zu times.", g_allocations - before));
+
+	for (size_t i = 0; i < keys.size(); i++)
+		if (tree.erase(std::string_view(keys[i])) != (i % 2 == 0))
+			throw TestFailed(fmt("Heterogeneous erase of %zu is wrong.", i));
+	if (tree.size() != 0)
+		throw TestFailed("Heterogeneous erase left some values.");
+}
+
+template <typename Compare, typename Key>
+void benchmark_find_with(const char *name, const std::vector<std::string> &keys, const std::vector<Key> &lookups) {
+	Tree<std::string, Compare> tree;
+	for (const auto &key : keys)
+		tree.insert(key);
+
+	size_t before = g_allocations;
+	auto start = std::chrono::steady_clock::now();
+	size_t found = 0;
+	for (const auto &lookup : lookups)
+		found += tree.find(lookup) != nullptr;
+	std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+	printf("%-28s %8.3f s %8.1f ns/find %10zu found %10zu allocations\n", name, time.count(),
+		   time.count() * 1e9 / lookups.size(), found, g_allocations - before);
+}
+
+// Lookups of string keys by std::string and by std::string_view
+void benchmark_find(size_t size = 1'000'000, size_t lookups = 1'000'000) {
+	std::mt19937 my_rand(42);
+	std::vector<std::string> keys;
+	for (size_t i = 0; i < size; i++)
+		keys.push_back(long_key(my_rand() % (2 * size)));
+	std::vector<std::string> strings;
+	for (size_t i = 0; i < lookups; i++)
+		strings.push_back(long_key(my_rand() % (2 * size)));
+	std::vector<std::string_view> views(strings.begin(), strings.end());
+
+	benchmark_find_with<std::less<std::string>>("std::string", keys, strings);
+	benchmark_find_with<std::less<>>("std::string_view", keys, views);
+}
+
+using SlabTree = Tree<size_t, std::less<size_t>, SlabNodes<>>;
+
+template <typename TestedTree>
+void test_sorted() {
+	for (size_t size = 0; size < 300; size++) {
+		std::vector<size_t> values;
+		for (size_t i = 0; i < size; i++)
+			values.push_back(3 * i + 1);
+		Tester<size_t, TestedTree> t;
+		t.tested = TestedTree::from_sorted(values.begin(), values.end());
+		for (size_t value : values)
+			t.ref.insert(value);
+		t.check_tree();
+		// perfectly balanced
+		size_t levels = 0;
+		while ((size_t(1) << levels) <= size)
+			levels++;
+		if (TestedTree::heightOf(t.tested.m_root) != levels)
+			throw TestFailed(fmt("Tree of %zu sorted values has %zu levels.", size, TestedTree::heightOf(t.tested.m_root)));
+		for (size_t i = 0; i < 3 * size + 2; i++)
+			t.find(i);
+		t.insert(3 * size / 2, true);
+		t.erase(3 * (size / 3) + 1, true);
+	}
+
+	std::mt19937 my_rand(17);
+	for (size_t round = 0; round < 200; round++) {
+		Tester<size_t, TestedTree> t;
+		size_t range = 1 + my_rand() % 20'000;
+		size_t size = my_rand() % (round < 100 ? 50 : 5000);
+		for (size_t i = 0; i < size; i++)
+			t.insert(my_rand() % range);
+		for (size_t batch = 0; batch < 4; batch++) {
+			std::vector<size_t> values;
+			size_t count = my_rand() % (batch % 2 ? 20 : 3000);
+			for (size_t i = 0; i < count; i++)
+				values.push_back(my_rand() % range);
+			std::sort(values.begin(), values.end());
+			values.erase(std::unique(values.begin(), values.end()), values.end());
+			t.insert_sorted_batch(values);
+		}
+		for (size_t i = 0; i < 100; i++)
+			t.erase(my_rand() % range);
+		t.check_tree();
+	}
+}
+
+std::vector<size_t> random_set(std::mt19937 &my_rand, size_t size, size_t range) {
+	std::vector<size_t> values(size);
+	for (auto &value : values)
+		value = my_rand() % range;
+	std::sort(values.begin(), values.end());
+	values.erase(std::unique(values.begin(), values.end()), values.end());
+	return values;
+}
+
+template <typename TestedTree>
+void test_set_operations() {
+	std::mt19937 my_rand(23);
+	enum Operation { UNION, INTERSECTION, DIFFERENCE };
+	for (size_t round = 0; round < 100; round++) {
+		size_t range = 1 + my_rand() % (round < 50 ? 100 : 100'000);
+		auto a = random_set(my_rand, my_rand() % (round % 7 ? 20'000 : 3), range);
+		auto b = random_set(my_rand, my_rand() % (round % 5 ? 20'000 : 3), range);
+		for (Operation operation : {UNION, INTERSECTION, DIFFERENCE}) {
+			std::vector<size_t> expected;
+			auto out = std::back_inserter(expected);
+			switch (operation) {
+				case UNION:
+					std::set_union(a.begin(), a.end(), b.begin(), b.end(), out);
+					break;
+				case INTERSECTION:
+					std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), out);
+					break;
+				case DIFFERENCE:
+					std::set_difference(a.begin(), a.end(), b.begin(), b.end(), out);
+			}
+			for (unsigned threads : {1, 4}) {
+				auto x = TestedTree::from_sorted(a.begin(), a.end());
+				auto y = TestedTree::from_sorted(b.begin(), b.end());
+				Tester<size_t, TestedTree> t;
+				switch (operation) {
+					case UNION:
+						t.tested = TestedTree::set_union(std::move(x), std::move(y), threads);
+						break;
+					case INTERSECTION:
+						t.tested = TestedTree::set_intersection(std::move(x), std::move(y), threads);
+						break;
+					case DIFFERENCE:
+						t.tested = TestedTree::set_difference(std::move(x), std::move(y), threads);
+				}
+				if (x.size() != 0 || y.size() != 0)
+					throw TestFailed("Set operation left values in its arguments.");
+				for (size_t value : expected)
+					t.ref.insert(value);
+				t.check_tree();
+				// the nodes of both pools can still be erased and reused
+				for (size_t i = 0; i < 20; i++)
+					t.erase(my_rand() % range);
+				for (size_t i = 0; i < 20; i++)
+					t.insert(my_rand() % range);
+				t.check_tree();
+			}
+		}
+
+		// the middle value of the join is not in either of the trees
+		size_t middle = my_rand() % range;
+		std::vector<size_t> less, greater;
+		for (size_t value : a)
+			(value < middle ? less : greater).push_back(value);
+		if (!greater.empty() && greater.front() == middle)
+			greater.erase(greater.begin());
+		Tester<size_t, TestedTree> t;
+		TestedTree left, right;
+		for (size_t value : less)
+			left.insert(value);
+		right.insert_sorted_batch(greater.begin(), greater.end());
+		t.tested = TestedTree::join(std::move(left), middle, std::move(right));
+		t.ref.insert(middle);
+		for (size_t value : a)
+			t.ref.insert(value);
+		t.check_tree();
+	}
+}
+
+// Set operations of two random sets on up to 8 threads, and the union by inserting the values of one set to the other
+void benchmark_set_operations(size_t size = 5'000'000) {
+	std::mt19937 my_rand(42);
+	auto a = random_set(my_rand, size, 4 * size);
+	auto b = random_set(my_rand, size, 4 * size);
+
+	auto start = std::chrono::steady_clock::now();
+	auto time = [&]() {
+		auto now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(now - start).count();
+		start = now;
+		return seconds;
+	};
+	{
+		auto x = Tree<size_t>::from_sorted(a.begin(), a.end());
+		time();
+		for (size_t value : b)
+			x.insert(value);
+		printf("insert %zu values to %zu:    %7.3f s\n", b.size(), a.size(), time());
+	}
+	for (unsigned threads : {1, 2, 4, 8}) {
+		double seconds[3];
+		for (int operation = 0; operation < 3; operation++) {
+			auto x = Tree<size_t>::from_sorted(a.begin(), a.end());
+			auto y = Tree<size_t>::from_sorted(b.begin(), b.end());
+			time();
+			auto result = operation == 0   ? Tree<size_t>::set_union(std::move(x), std::move(y), threads)
+						  : operation == 1 ? Tree<size_t>::set_intersection(std::move(x), std::move(y), threads)
+										   : Tree<size_t>::set_difference(std::move(x), std::move(y), threads);
+			seconds[operation] = time();
+		}
+		printf("%u threads: union %7.3f s, intersection %7.3f s, difference %7.3f s\n", threads, seconds[0], seconds[1],
+			   seconds[2]);
+	}
+}
+
+void test_ranges() {
+	std::mt19937 my_rand(31);
+	for (size_t round = 0; round < 200; round++) {
+		Tester<size_t> t;
+		size_t range = 1 + my_rand() % 1000;
+		size_t size = my_rand() % (round < 100 ? 30 : 1000);
+		for (size_t i = 0; i < size; i++)
+			t.insert(my_rand() % range);
+		for (size_t i = 0; i < size / 3; i++)
+			t.erase(my_rand() % range);
+		t.check_iteration();
+		for (size_t i = 0; i < range + 2; i++)
+			t.bounds(i);
+		for (size_t i = 0; i < 100; i++) {
+			size_t from = my_rand() % (range + 2);
+			t.range(from, from + my_rand() % (range / 4 + 2));
+		}
+		t.range(5, 3);
+	}
+
+	// the iterators work with the standard algorithms
+	std::vector<size_t> sorted = {1, 3, 5, 7};
+	auto tree = Tree<size_t>::from_sorted(sorted.begin(), sorted.end());
+	std::vector<size_t> values(tree.begin(), tree.end());
+	std::vector<size_t> reversed(std::make_reverse_iterator(tree.end()), std::make_reverse_iterator(tree.begin()));
+	if (values != sorted || reversed != std::vector<size_t>{7, 5, 3, 1} ||
+		std::distance(tree.lower_bound(2), tree.upper_bound(6)) != 2)
+		throw TestFailed("Iterators do not work with the standard algorithms.");
+
+	Tree<std::string, std::less<>> strings;
+	for (const char *value : {"apple", "banana", "cherry", "date"})
+		strings.insert(value);
+	std::string joined;
+	strings.for_each_in_range(std::string_view("b"), std::string_view("d"), [&](const std::string &value) { joined += value; });
+	if (joined != "bananacherry" || *strings.lower_bound(std::string_view("c")) != "cherry")
+		throw TestFailed("Heterogeneous range mismatch.");
+}
+
+using SizedTree = Tree<size_t, std::less<size_t>, HeapNodes, SubtreeSizes>;
+
+template <typename TestedTree>
+void check_order_statistics(const Tester<size_t, TestedTree> &t, size_t range) {
+	size_t k = 0;
+	for (size_t value : t.ref) {
+		const size_t *selected = t.tested.select(k);
+		if (!selected || *selected != value)
+			throw TestFailed(fmt("Select of %zu mismatch.", k));
+		k++;
+	}
+	if (t.tested.select(k))
+		throw TestFailed("Select past the end found a value.");
+	for (size_t x = 0; x < range + 2; x++)
+		if (t.tested.rank(x) != size_t(std::distance(t.ref.begin(), t.ref.lower_bound(x))))
+			throw TestFailed(fmt("Rank of %zu mismatch.", x));
+}
+
+template <typename TestedTree>
+void test_order_statistics() {
+	std::mt19937 my_rand(37);
+	for (size_t round = 0; round < 100; round++) {
+		size_t range = 1 + my_rand() % 3000;
+		Tester<size_t, TestedTree> t;
+		for (size_t i = 0; i < range / 2; i++)
+			t.insert(my_rand() % range);
+		check_order_statistics(t, range);
+		for (size_t i = 0; i < range / 4; i++)
+			t.erase(my_rand() % range);
+		check_order_statistics(t, range);
+		// sparse and dense batches
+		t.insert_sorted_batch(random_set(my_rand, range / 20, range));
+		t.insert_sorted_batch(random_set(my_rand, range, range));
+		check_order_statistics(t, range);
+
+		auto a = random_set(my_rand, range / 2, range);
+		auto b = random_set(my_rand, range / 2, range);
+		std::vector<size_t> expected;
+		std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+		Tester<size_t, TestedTree> d;
+		d.tested = TestedTree::set_difference(TestedTree::from_sorted(a.begin(), a.end()),
+											  TestedTree::from_sorted(b.begin(), b.end()), 2);
+		for (size_t value : expected)
+			d.ref.insert(value);
+		check_order_statistics(d, range);
+	}
+
+	// plain trees do not pay for the sizes
+	static_assert(sizeof(Tree<size_t>::Node) + sizeof(size_t) == sizeof(SizedTree::Node));
+}
+
+// select and rank with subtree sizes and by walking std::set, and the cost of keeping the sizes in inserts
+void benchmark_order_statistics(size_t size = 1'000'000, size_t queries = 1'000'000) {
+	std::mt19937_64 my_rand(42);
+	std::vector<size_t> values(size);
+	for (auto &value : values)
+		value = my_rand() % (4 * size);
+
+	auto start = std::chrono::steady_clock::now();
+	auto time = [&]() {
+		auto now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(now - start).count();
+		start = now;
+		return seconds;
+	};
+	Tree<size_t> plain;
+	for (size_t value : values)
+		plain.insert(value);
+	double plainInsert = time();
+	SizedTree sized;
+	for (size_t value : values)
+		sized.insert(value);
+	printf("insert %zu values: plain %7.3f s, with sizes %7.3f s\n", size, plainInsert, time());
+
+	size_t sum = 0;
+	for (size_t i = 0; i < queries; i++)
+		sum += *sized.select(my_rand() % sized.size());
+	double select = time();
+	for (size_t i = 0; i < queries; i++)
+		sum += sized.rank(my_rand() % (4 * size));
+	double rank = time();
+	printf("%zu queries: select %7.3f s, rank %7.3f s (%zu)\n", queries, select, rank, sum);
+
+	std::set<size_t> set(values.begin(), values.end());
+	time();
+	size_t walked = std::min<size_t>(queries, 10);
+	for (size_t i = 0; i < walked; i++)
+		sum += *std::next(set.begin(), my_rand() % set.size());
+	printf("%zu selects by walking std::set: %7.3f s (%zu)\n", walked, time(), sum);
+}
+
+// Payloads with weights, ordered and looked up by their keys
+using Weighted = std::pair<size_t, long long>;
+
+struct ByKey {
+	using is_transparent = void;
+	bool operator()(const Weighted &a, const Weighted &b) const { return a.first < b.first; }
+	bool operator()(size_t a, const Weighted &b) const { return a < b.first; }
+	bool operator()(const Weighted &a, size_t b) const { return a.first < b; }
+};
+
+struct WeightSum {
+	using Value = long long;
+	static Value identity() { return 0; }
+	static Value of(const Weighted &value) { return value.second; }
+	static Value combine(Value a, Value b) { return a + b; }
+};
+
+// A hash of the values in order, so that the order of combining matters
+struct Polynomial {
+	struct Value {
+		uint64_t hash;
+		uint64_t power;
+		bool operator!=(const Value &other) const { return hash != other.hash || power != other.power; }
+	};
+	static Value identity() { return {0, 1}; }
+	static Value of(size_t value) { return {value + 1, 1'000'003}; }
+	static Value combine(const Value &a, const Value &b) { return {a.hash * b.power + b.hash, a.power * b.power}; }
+};
+
+using WeightedTree = Tree<Weighted, ByKey, HeapNodes, Aggregate<WeightSum>>;
+
+void test_aggregates() {
+	std::mt19937 my_rand(41);
+	for (size_t round = 0; round < 100; round++) {
+		size_t range = 1 + my_rand() % 2000;
+		WeightedTree weighted;
+		std::set<size_t> keys;
+		std::vector<long long> weights(range);
+		for (size_t i = 0; i < range; i++) {
+			size_t key = my_rand() % range;
+			long long weight = (long long)(my_rand() % 2001) - 1000;
+			if (weighted.emplace(key, weight)) {
+				keys.insert(key);
+				weights[key] = weight;
+			}
+			if (i % 3 == 0) {
+				key = my_rand() % range;
+				weighted.erase(key);
+				keys.erase(key);
+			}
+		}
+		for (size_t i = 0; i < 200; i++) {
+			size_t from = my_rand() % (range + 2);
+			size_t to = my_rand() % 4 ? from + my_rand() % (range / 3 + 2) : my_rand() % (range + 2);
+			long long expected = 0;
+			for (auto it = keys.lower_bound(from); it != keys.end() && *it < to; ++it)
+				expected += weights[*it];
+			if (weighted.range_aggregate(from, to) != expected)
+				throw TestFailed(fmt("Weight of [%zu, %zu) mismatch.", from, to));
+		}
+		long long total = 0;
+		for (size_t key : keys)
+			total += weights[key];
+		if (weighted.aggregate() != total)
+			throw TestFailed("Total weight mismatch.");
+
+		using HashTree = Tree<size_t, std::less<size_t>, SlabNodes<64>, Aggregate<Polynomial>>;
+		auto a = random_set(my_rand, range / 2, range);
+		auto b = random_set(my_rand, range / 2, range);
+		HashTree hashed = HashTree::set_union(HashTree::from_sorted(a.begin(), a.end()), HashTree(), 2);
+		hashed.insert_sorted_batch(b.begin(), b.end());
+		for (size_t i = 0; i < range / 10; i++)
+			hashed.erase(my_rand() % range);
+		for (size_t i = 0; i < 200; i++) {
+			size_t from = my_rand() % (range + 2);
+			size_t to = from + my_rand() % (range / 3 + 2);
+			auto expected = Polynomial::identity();
+			hashed.for_each_in_range(from, to, [&](size_t value) {
+				expected = Polynomial::combine(expected, Polynomial::of(value));
+			});
+			if (hashed.range_aggregate(from, to) != expected)
+				throw TestFailed(fmt("Hash of [%zu, %zu) mismatch.", from, to));
+		}
+	}
+
+	Tree<int, std::less<int>, HeapNodes, Aggregate<Max<int>>> maximums;
+	for (int value : {5, -3, 8, 1})
+		maximums.insert(value);
+	if (maximums.range_aggregate(-10, 8) != 5 || maximums.range_aggregate(2, 5) != std::numeric_limits<int>::lowest())
+		throw TestFailed("Range maximum mismatch.");
+}
+
+// range_aggregate and summing the range by visiting it, for ranges of different widths
+void benchmark_aggregates(size_t size = 1'000'000, size_t queries = 100'000) {
+	std::mt19937_64 my_rand(42);
+	WeightedTree tree;
+	for (size_t i = 0; i < size; i++)
+		tree.emplace(my_rand() % (4 * size), my_rand() % 1000);
+	for (size_t width : {size_t(8), size_t(1000), size_t(100'000)}) {
+		size_t count = std::max<size_t>(queries * 8 / width, 10);
+		std::vector<size_t> froms(count);
+		for (auto &from : froms)
+			from = my_rand() % (4 * size);
+
+		long long aggregated = 0, visited = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t from : froms)
+			aggregated += tree.range_aggregate(from, from + width);
+		auto middle = std::chrono::steady_clock::now();
+		for (size_t from : froms)
+			tree.for_each_in_range(from, from + width, [&](const Weighted &value) { visited += value.second; });
+		auto stop = std::chrono::steady_clock::now();
+		printf("%7zu ranges of width %6zu: range_aggregate %7.3f s, visiting %7.3f s%s\n", count, width,
+			   std::chrono::duration<double>(middle - start).count(), std::chrono::duration<double>(stop - middle).count(),
+			   aggregated == visited ? "" : " (mismatch)");
+	}
+}
+
+// Range scans with for_each_in_range and std::set, for ranges of different widths
+void benchmark_ranges(size_t size = 1'000'000, size_t queries = 100'000) {
+	std::mt19937_64 my_rand(42);
+	Tree<size_t> tree;
+	std::set<size_t> set;
+	for (size_t i = 0; i < size; i++) {
+		size_t value = my_rand() % (4 * size);
+		tree.insert(value);
+		set.insert(value);
+	}
+	for (size_t width : {size_t(8), size_t(1000), size_t(100'000)}) {
+		size_t count = std::max<size_t>(queries * 8 / width, 10);
+		std::vector<size_t> froms(count);
+		for (auto &from : froms)
+			from = my_rand() % (4 * size);
+
+		size_t sum_t = 0, sum_r = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t from : froms)
+			tree.for_each_in_range(from, from + width, [&](size_t value) { sum_t += value; });
+		auto middle = std::chrono::steady_clock::now();
+		for (size_t from : froms)
+			for (auto it = set.lower_bound(from), end = set.lower_bound(from + width); it != end; ++it)
+				sum_r += *it;
+		auto stop = std::chrono::steady_clock::now();
+		printf("%7zu ranges of width %6zu: Tree %7.3f s, std::set %7.3f s%s\n", count, width,
+			   std::chrono::duration<double>(middle - start).count(), std::chrono::duration<double>(stop - middle).count(),
+			   sum_t == sum_r ? "" : " (mismatch)");
+	}
+}
+
+// Loading sorted values one by one and all at once, and merging sorted batches into a tree
+void benchmark_sorted(size_t size = 10'000'000) {
+	std::vector<size_t> values(size);
+	for (size_t i = 0; i < size; i++)
+		values[i] = 2 * i;
+
+	auto start = std::chrono::steady_clock::now();
+	auto time = [&]() {
+		auto now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(now - start).count();
+		start = now;
+		return seconds;
+	};
+	{
+		Tree<size_t> tree;
+		for (size_t value : values)
+			tree.insert(value);
+		printf("insert %zu sorted values:       %7.3f s\n", size, time());
+	}
+	time();
+	auto tree = Tree<size_t>::from_sorted(values.begin(), values.end());
+	printf("from_sorted %zu sorted values:  %7.3f s\n", size, time());
+
+	std::mt19937_64 my_rand(42);
+	for (size_t count : {size_t(1000), size / 100, size / 10, size}) {
+		std::vector<size_t> batch(count);
+		for (auto &value : batch)
+			value = my_rand() % (2 * size);
+		std::sort(batch.begin(), batch.end());
+		batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+
+		auto inserted = Tree<size_t>::from_sorted(values.begin(), values.end());
+		time();
+		for (size_t value : batch)
+			inserted.insert(value);
+		double insert = time();
+		auto merged = Tree<size_t>::from_sorted(values.begin(), values.end());
+		time();
+		merged.insert_sorted_batch(batch.begin(), batch.end());
+		printf("batch of %9zu: insert %7.3f s, insert_sorted_batch %7.3f s\n", batch.size(), insert, time());
+	}
+}
+
+void test_slab() {
+	// small slabs, so that the nodes span many of them
+	test_random<Tree<size_t, std::less<size_t>, SlabNodes<16>>>(200, CHECK_TREE);
+	test_random<Tree<size_t, std::less<size_t>, SlabNodes<16>>>(50'000);
+
+	// erased nodes are reused
+	SlabTree tree;
+	for (size_t i = 0; i < 5000; i++)
+		tree.insert(i * 7 % 5000);
+	for (size_t i = 0; i < 5000; i++)
+		tree.erase(i);
+	size_t before = g_allocations;
+	for (size_t i = 0; i < 5000; i++)
+		tree.insert(i);
+	if (g_allocations != before)
+		throw TestFailed(fmt("Refilling the slabs allocated %zu times.", g_allocations - before));
+	tree.clear();
+	if (tree.size() != 0 || tree.find(1) || !tree.insert(1) || !tree.find(1))
+		throw TestFailed("The cleared tree is not empty.");
+
+	// values that are not trivially destructible are destroyed with their tree
+	auto shared = std::make_shared<int>(0);
+	{
+		Tree<std::pair<size_t, std::shared_ptr<int>>, std::less<>, SlabNodes<64>> values;
+		Tree<std::pair<size_t, std::shared_ptr<int>>> heapValues;
+		for (size_t i = 0; i < 1000; i++) {
+			values.emplace(i, shared);
+			heapValues.emplace(i, shared);
+		}
+		for (size_t i = 0; i < 1000; i += 3)
+			values.erase(std::make_pair(i, shared));
+	}
+	if (shared.use_count() != 1)
+		throw TestFailed(fmt("%ld values were not destroyed.", shared.use_count() - 1));
+}
+
+template <typename TestedTree>
+void benchmark_nodes_with(const char *name, const std::vector<size_t> &keys) {
+	auto start = std::chrono::steady_clock::now();
+	auto time = [&]() {
+		auto now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(now - start).count();
+		start = now;
+		return seconds;
+	};
+	double insert, find, erase;
+	size_t found = 0;
+	{
+		TestedTree tree;
+		for (size_t key : keys)
+			tree.insert(key);
+		insert = time();
+		for (size_t key : keys)
+			found += tree.find(key + 1) != nullptr;
+		find = time();
+		for (size_t i = 0; i < keys.size(); i += 2)
+			tree.erase(keys[i]);
+		for (size_t i = 0; i < keys.size(); i += 2)
+			tree.insert(keys[i]);
+		erase = time();
+	}
+	printf("%-12s insert %7.3f s, find %7.3f s, erase and insert %7.3f s, destroy %7.3f s (%zu found)\n", name, insert,
+		   find, erase, time(), found);
+}
+
+// Node allocation with new and from slabs
+void benchmark_nodes(size_t size = 1'000'000) {
+	std::mt19937_64 my_rand(42);
+	std::vector<size_t> keys(size);
+	for (auto &key : keys)
+		key = my_rand() % (4 * size);
+	benchmark_nodes_with<Tree<size_t>>("new", keys);
+	benchmark_nodes_with<SlabTree>("slabs", keys);
+}
+
+// A big payload that can only be moved
+struct Payload {
+	size_t key;
+	std::unique_ptr<size_t[]> data;
+
+	Payload(size_t key, size_t length) : key(key), data(new size_t[length]) {
+		std::fill_n(data.get(), length, key);
+	}
+
+	bool operator<(const Payload &other) const { return key < other.key; }
+};
+
+// Counts how many times its values are copied and moved
+struct Counted {
+	static inline size_t copies = 0;
+	static inline size_t moves = 0;
+
+	size_t key;
+
+	explicit Counted(size_t key) : key(key) {}
+	Counted(const Counted &other) : key(other.key) { ++copies; }
+	Counted(Counted &&other) noexcept : key(other.key) { ++moves; }
+	Counted &operator=(const Counted &other) {
+		key = other.key;
+		++copies;
+		return *this;
+	}
+	Counted &operator=(Counted &&other) noexcept {
+		key = other.key;
+		++moves;
+		return *this;
+	}
+};
+
+struct CountedLess {
+	using is_transparent = void;
+	bool operator()(const Counted &a, const Counted &b) const { return a.key < b.key; }
+	bool operator()(size_t a, const Counted &b) const { return a < b.key; }
+	bool operator()(const Counted &a, size_t b) const { return a.key < b; }
+};
+
+void test_move_only() {
+	Tree<Payload> tree;
+	std::set<size_t> ref;
+	std::mt19937 my_rand(5);
+	for (size_t i = 0; i < 20'000; i++) {
+		size_t key = my_rand() % 10'000;
+		bool inserted = i % 2 ? tree.insert(Payload(key, 4)) : tree.emplace(key, 4);
+		if (inserted != ref.insert(key).second)
+			throw TestFailed(fmt("Insert of the payload %zu mismatch.", key));
+		key = my_rand() % 10'000;
+		if (tree.erase(Payload(key, 0)) != (ref.erase(key) == 1))
+			throw TestFailed(fmt("Erase of the payload %zu mismatch.", key));
+	}
+	if (tree.size() != ref.size())
+		throw TestFailed("Payload tree has a wrong size.");
+	for (size_t key = 0; key < 10'000; key++) {
+		const Payload *found = tree.find(Payload(key, 0));
+		if ((found != nullptr) != (ref.count(key) == 1))
+			throw TestFailed(fmt("Find of the payload %zu mismatch.", key));
+		if (found && (found->key != key || found->data[0] != key || found->data[3] != key))
+			throw TestFailed(fmt("Payload %zu was damaged.", key));
+	}
+
+	Tree<Counted, CountedLess> counted;
+	Counted::copies = Counted::moves = 0;
+	for (size_t i = 0; i < 1000; i++) {
+		size_t key = (i * 7919) % 1000;
+		if (!(i % 2 ? counted.emplace(key) : counted.insert(Counted(key))))
+			throw TestFailed(fmt("Insert of %zu failed.", key));
+		if (counted.emplace(key) || counted.insert(Counted(key)))
+			throw TestFailed(fmt("Insert of the duplicate %zu succeeded.", key));
+	}
+	// one move for each inserted temporary, none for the emplaced keys and the duplicates
+	if (Counted::copies != 0 || Counted::moves != 500)
+		throw TestFailed(fmt("Inserts made %zu copies and %zu moves.", Counted::copies, Counted::moves));
+	for (size_t key = 0; key < 1000; key++)
+		if (!counted.erase(key) || counted.find(key))
+			throw TestFailed(fmt("Erase of %zu failed.", key));
+	if (Counted::copies != 0 || Counted::moves != 500)
+		throw TestFailed(fmt("Erases made %zu copies and %zu moves.", Counted::copies, Counted::moves - 500));
+}
+
+// Counts the nodes whose summaries would be updated, which are the nodes the retracing touches, without keeping any
+struct CountUpdates {
+	static constexpr bool ENABLED = false;
+	static inline size_t updates = 0;
+
+	template <typename T>
+	struct Data {
+		void update(const T &, const Data *, const Data *) { updates++; }
+	};
+};
+
+template <typename Node>
+size_t depth_sum(const Node *n, size_t depth) {
+	return n ? depth + depth_sum(n->m_leftChild, depth + 1) + depth_sum(n->m_rightChild, depth + 1) : 0;
+}
+
+// Bytes per node and nodes retraced per insert and erase, against the ancestors a retrace up to the root visits
+void benchmark_retrace(size_t size = 1'000'000) {
+	using CountedTree = Tree<size_t, std::less<size_t>, HeapNodes, CountUpdates>;
+	printf("node of Tree<size_t>: %zu bytes, with subtree sizes: %zu bytes\n", sizeof(Tree<size_t>::Node),
+		   sizeof(SizedTree::Node));
+
+	std::mt19937_64 my_rand(42);
+	std::vector<size_t> keys(size);
+	for (auto &key : keys)
+		key = my_rand();
+	CountedTree tree;
+	auto start = std::chrono::steady_clock::now();
+	CountUpdates::updates = 0;
+	for (size_t key : keys)
+		tree.insert(key);
+	std::chrono::duration<double> insert = std::chrono::steady_clock::now() - start;
+	// the constructor of each node counts once
+	double inserted = double(CountUpdates::updates - size) / size;
+	double depth = double(depth_sum(tree.m_root, 1)) / size;
+
+	std::shuffle(keys.begin(), keys.end(), my_rand);
+	keys.resize(size / 2);
+	start = std::chrono::steady_clock::now();
+	CountUpdates::updates = 0;
+	for (size_t key : keys)
+		tree.erase(key);
+	std::chrono::duration<double> erase = std::chrono::steady_clock::now() - start;
+	double erased = double(CountUpdates::updates) / keys.size();
+	printf("%zu inserts: %7.3f s, %5.2f nodes retraced\n", size, insert.count(), inserted);
+	printf("%zu erases:  %7.3f s, %5.2f nodes retraced\n", keys.size(), erase.count(), erased);
+	printf("average depth of a node: %5.2f\n", depth);
+}
+
+// Payload copies and moves of the ways to fill a tree
+void benchmark_payloads(size_t size = 1'000'000) {
+	std::mt19937 my_rand(42);
+	std::vector<size_t> keys(size);
+	for (auto &key : keys)
+		key = my_rand();
+
+	auto run = [&](const char *name, auto insert) {
+		Tree<Counted, CountedLess> tree;
+		Counted::copies = Counted::moves = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t key : keys)
+			insert(tree, key);
+		for (size_t key : keys)
+			tree.erase(key);
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		printf("%-20s %8.3f s %10zu copies %10zu moves\n", name, time.count(), Counted::copies, Counted::moves);
+	};
+	run("insert(const T &)", [](auto &tree, size_t key) {
+		Counted value(key);
+		tree.insert(value);
+	});
+	run("insert(T &&)", [](auto &tree, size_t key) { tree.insert(Counted(key)); });
+	run("emplace(key)", [](auto &tree, size_t key) { tree.emplace(key); });
+}
+
+// Checks the number of keys, the order, the separators, the free slots and the depth of the leaves below the node
+template <typename TestedTree, typename T>
+void check_btree(const TestedTree &tree, const typename TestedTree::Node *n, size_t level, const T *low, const T *high,
+				 std::vector<T> &values) {
+	if (n != tree.m_root && (n->m_count < TestedTree::MIN_KEYS || n->m_count > TestedTree::KEYS))
+		throw TestFailed(fmt("B-tree node has %zu keys.", n->m_count));
+	for (size_t i = 0; i < n->m_count; i++)
+		if ((i > 0 && !tree.m_compare(n->m_keys[i - 1], n->m_keys[i])) || (low && !tree.m_compare(*low, n->m_keys[i])) ||
+			(high && tree.m_compare(*high, n->m_keys[i])))
+			throw TestFailed("B-tree keys are out of order.");
+	if constexpr (TestedTree::BRANCHLESS)
+		for (size_t i = n->m_count; i < TestedTree::KEYS; i++)
+			if (n->m_keys[i] != TestedTree::largest())
+				throw TestFailed("B-tree node has a free slot without the largest value.");
+	if (level == 0) {
+		values.insert(values.end(), n->m_keys, n->m_keys + n->m_count);
+		return;
+	}
+	const auto *inner = static_cast<const typename TestedTree::Inner *>(n);
+	for (size_t i = 0; i <= n->m_count; i++)
+		check_btree(tree, inner->m_children[i], level - 1, i > 0 ? &n->m_keys[i - 1] : low,
+					i < n->m_count ? &n->m_keys[i] : high, values);
+}
+
+template <typename TestedTree, typename T>
+void check_btree(const TestedTree &tree, const std::set<T, decltype(TestedTree::m_compare)> &ref) {
+	std::vector<T> values;
+	if (tree.m_root)
+		check_btree(tree, tree.m_root, tree.m_height, (const T *)nullptr, (const T *)nullptr, values);
+	if (tree.size() != ref.size() || !std::equal(values.begin(), values.end(), ref.begin(), ref.end()))
+		throw TestFailed("B-tree values mismatch.");
+}
+
+template <typename TestedTree, typename Key>
+void test_btree(Key key) {
+	using T = decltype(key(0));
+	for (size_t size : {20, 200, 10'000}) {
+		TestedTree tree;
+		std::set<T, decltype(TestedTree::m_compare)> ref;
+		std::mt19937 my_rand(size);
+		auto insert = [&](const T &value) {
+			if (tree.insert(value) != ref.insert(value).second)
+				throw TestFailed("B-tree insert mismatch.");
+		};
+		auto erase = [&](const T &value) {
+			if (tree.erase(value) != (ref.erase(value) == 1))
+				throw TestFailed("B-tree erase mismatch.");
+		};
+		auto find = [&](const T &value) {
+			const T *found = tree.find(value);
+			if ((found != nullptr) != (ref.count(value) == 1) || (found && *found != value))
+				throw TestFailed("B-tree find mismatch.");
+		};
+		for (size_t i = 0; i < size; i++)
+			insert(key(my_rand() % (3 * size)));
+		check_btree(tree, ref);
+		for (size_t i = 0; i < 3 * size; i++)
+			find(key(i));
+		for (size_t i = 0; i < 10 * size; i++) {
+			switch (my_rand() % 3) {
+				case 0:
+					insert(key(my_rand() % (3 * size)));
+					break;
+				case 1:
+					erase(key(my_rand() % (3 * size)));
+					break;
+				default:
+					find(key(my_rand() % (3 * size)));
+			}
+			if (size <= 200)
+				check_btree(tree, ref);
+		}
+		check_btree(tree, ref);
+		for (size_t i = 0; i < 3 * size; i++)
+			erase(key(i));
+		check_btree(tree, ref);
+	}
+}
+
+void test_btrees() {
+	auto number = [](size_t i) { return i; };
+	test_btree<BTree<size_t>>(number);
+	test_btree<BTree<size_t, std::less<size_t>, 1>>(number);
+	test_btree<BTree<int, std::greater<int>>>([](size_t i) { return (int)i - 1000; });
+	test_btree<BTree<double>>([](size_t i) { return i * 0.5; });
+	test_btree<BTree<std::string, std::less<std::string>, 1>>([](size_t i) { return long_key(i); });
+}
+
+// Lookups and inserts of random keys in the B-tree, the AVL tree and std::set
+template <typename Set>
+void benchmark_btree_with(const char *name, const std::vector<size_t> &keys) {
+	auto start = std::chrono::steady_clock::now();
+	auto time = [&]() {
+		auto now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(now - start).count();
+		start = now;
+		return seconds;
+	};
+	Set set;
+	for (size_t key : keys)
+		set.insert(key);
+	double insert = time();
+	size_t found = 0;
+	for (size_t key : keys) {
+		if constexpr (std::is_pointer_v<decltype(set.find(key))>)
+			found += set.find(key + 1) != nullptr;
+		else
+			found += set.find(key + 1) != set.end();
+	}
+	double find = time();
+	for (size_t key : keys)
+		set.erase(key);
+	double erase = time();
+	printf("%-10s %11zu keys: insert %6.2f M/s, find %6.2f M/s, erase %6.2f M/s (%zu found)\n", name, keys.size(),
+		   keys.size() / insert / 1e6, keys.size() / find / 1e6, keys.size() / erase / 1e6, found);
+}
+
+void benchmark_btree(size_t max_size = 10'000'000) {
+	std::mt19937_64 my_rand(42);
+	for (size_t size = 1'000; size <= max_size; size *= 10) {
+		std::vector<size_t> keys(size);
+		for (auto &key : keys)
+			key = my_rand() % (2 * size);
+		benchmark_btree_with<BTree<size_t>>("B-tree", keys);
+		benchmark_btree_with<BTree<size_t, std::less<size_t>, 1>>("B-tree 1", keys);
+		benchmark_btree_with<Tree<size_t>>("AVL", keys);
+		benchmark_btree_with<std::set<size_t>>("std::set", keys);
+	}
+}
+
+// Checks the links, the order, the heights and the balance of a concurrent tree no thread is changing, returns its height
+template <typename TestedTree>
+int check_concurrent(const TestedTree &tree, const typename TestedTree::Node *n, const typename TestedTree::Node *parent,
+					 size_t &present) {
+	if (!n)
+		return 0;
+	if (n->m_parent.load() != parent)
+		throw TestFailed("Concurrent tree has a wrong parent link.");
+	if (n->m_version.load() & (TestedTree::UNLINKED | TestedTree::SHRINKING))
+		throw TestFailed("Concurrent tree reaches an unlinked or shrinking node.");
+	const auto *left = n->m_leftChild.load();
+	const auto *right = n->m_rightChild.load();
+	if ((left && !tree.m_compare(left->value(), n->value())) || (right && !tree.m_compare(n->value(), right->value())))
+		throw TestFailed("Concurrent tree is not ordered.");
+	int leftHeight = check_concurrent(tree, left, n, present);
+	int rightHeight = check_concurrent(tree, right, n, present);
+	if (n->m_height.load() != 1 + std::max(leftHeight, rightHeight) || std::abs(leftHeight - rightHeight) > 1)
+		throw TestFailed("Concurrent tree has a wrong height or is not balanced.");
+	if (n->m_present.load())
+		present++;
+	else if (!left || !right)
+		throw TestFailed("Concurrent tree keeps a routing node with less than two children.");
+	return n->m_height.load();
+}
+
+template <typename TestedTree>
+void check_concurrent(const TestedTree &tree, const std::set<size_t> &ref) {
+	size_t present = 0;
+	check_concurrent(tree, tree.m_holder.m_rightChild.load(), &tree.m_holder, present);
+	if (present != ref.size() || tree.size() != ref.size())
+		throw TestFailed(fmt("Concurrent tree has %zu values and size %zu, expected %zu.", present, tree.size(), ref.size()));
+	for (size_t value : ref)
+		if (!tree.find(value))
+			throw TestFailed(fmt("Concurrent tree lost %zu.", value));
+}
+
+void test_concurrent() {
+	{
+		ConcurrentTree<size_t> tree;
+		std::set<size_t> ref;
+		std::mt19937 my_rand(6);
+		for (size_t i = 0; i < 100'000; i++) {
+			size_t value = my_rand() % 2'000;
+			bool insert = my_rand() % 2;
+			if (insert ? tree.insert(value) != ref.insert(value).second : tree.erase(value) != (ref.erase(value) == 1))
+				throw TestFailed(fmt("Concurrent %s of %zu mismatch.", insert ? "insert" : "erase", value));
+			if (i % 10'000 == 0)
+				check_concurrent(tree, ref);
+		}
+		check_concurrent(tree, ref);
+		for (size_t value = 0; value < 2'000; value++)
+			if (tree.find(value).has_value() != (ref.count(value) == 1))
+				throw TestFailed(fmt("Concurrent find of %zu mismatch.", value));
+		// without readers the unlinked nodes are freed two epochs later
+		if (tree.m_retiredCount.load() >= 2 * ConcurrentTree<size_t>::RECLAIM_BATCH)
+			throw TestFailed(fmt("Concurrent tree keeps %zu unlinked nodes.", tree.m_retiredCount.load()));
+	}
+
+	// Writers change their own odd values, the even values stay, readers must see all of them and none of the rest
+	const size_t writers = 3, readers = 3, range = 1'000;
+	ConcurrentTree<size_t> tree;
+	std::set<size_t> ref;
+	for (size_t value = 0; value < writers * range; value += 2) {
+		tree.insert(value);
+		ref.insert(value);
+	}
+	std::atomic<bool> done{false};
+	std::atomic<size_t> failures{0};
+	std::vector<std::set<size_t>> written(writers);
+	std::vector<std::thread> threads;
+	for (size_t w = 0; w < writers; w++)
+		threads.emplace_back([&, w]() {
+			std::mt19937 my_rand(w);
+			auto &mine = written[w];
+			for (size_t i = 0; i < 20'000; i++) {
+				size_t value = w * range + (my_rand() % (range / 2)) * 2 + 1;
+				bool insert = my_rand() % 2;
+				if (insert ? tree.insert(value) != mine.insert(value).second : tree.erase(value) != (mine.erase(value) == 1))
+					failures++;
+			}
+		});
+	for (size_t r = 0; r < readers; r++)
+		threads.emplace_back([&, r]() {
+			std::mt19937 my_rand(100 + r);
+			while (!done.load()) {
+				size_t value = (my_rand() % (writers * range / 2)) * 2;
+				std::optional<size_t> found = tree.find(value);
+				if (!found || *found != value || tree.find(writers * range + value))
+					failures++;
+			}
+		});
+	for (size_t w = 0; w < writers; w++)
+		threads[w].join();
+	done = true;
+	for (size_t r = 0; r < readers; r++)
+		threads[writers + r].join();
+	if (failures)
+		throw TestFailed(fmt("Concurrent tree failed %zu operations.", failures.load()));
+	for (const auto &mine : written)
+		ref.insert(mine.begin(), mine.end());
+	check_concurrent(tree, ref);
+	// the writers unlinked thousands of nodes, only the last few can still be waiting for the readers
+	if (tree.m_retiredCount.load() >= (writers + readers + 2) * ConcurrentTree<size_t>::RECLAIM_BATCH)
+		throw TestFailed(fmt("Concurrent tree keeps %zu unlinked nodes.", tree.m_retiredCount.load()));
+}
+
+// 99 % finds and 1 % inserts and erases on a concurrent tree and on a tree behind one mutex
+template <typename Run>
+void benchmark_concurrent_with(const char *name, size_t operations, Run run) {
+	for (unsigned threads : {1, 2, 4, 8}) {
+		std::vector<std::thread> pool;
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned t = 0; t < threads; t++)
+			pool.emplace_back([&, t]() { run(t, operations / threads); });
+		for (auto &thread : pool)
+			thread.join();
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		printf("%-16s %u threads: %7.3f s, %6.2f M ops/s\n", name, threads, time.count(),
+			   operations / time.count() / 1e6);
+	}
+}
+
+void benchmark_concurrent(size_t size = 1'000'000, size_t operations = 2'000'000) {
+	std::mt19937 my_rand(42);
+	std::vector<size_t> keys(size);
+	for (auto &key : keys)
+		key = my_rand() % (2 * size);
+
+	ConcurrentTree<size_t> concurrent;
+	Tree<size_t> locked;
+	std::mutex mutex;
+	for (size_t key : keys) {
+		concurrent.insert(key);
+		locked.insert(key);
+	}
+	std::atomic<size_t> hits{0};
+	benchmark_concurrent_with("concurrent", operations, [&](unsigned t, size_t count) {
+		std::mt19937 thread_rand(t);
+		size_t found = 0;
+		for (size_t i = 0; i < count; i++) {
+			size_t key = thread_rand() % (2 * size);
+			if (i % 100 == 0)
+				i % 200 == 0 ? concurrent.insert(key) : concurrent.erase(key);
+			else
+				found += concurrent.find(key).has_value();
+		}
+		hits += found;
+	});
+	benchmark_concurrent_with("mutex", operations, [&](unsigned t, size_t count) {
+		std::mt19937 thread_rand(t);
+		size_t found = 0;
+		for (size_t i = 0; i < count; i++) {
+			size_t key = thread_rand() % (2 * size);
+			std::lock_guard<std::mutex> guard(mutex);
+			if (i % 100 == 0)
+				i % 200 == 0 ? locked.insert(key) : locked.erase(key);
+			else
+				found += locked.find(key) != nullptr;
+		}
+		hits += found;
+	});
+	printf("%zu hits\n", hits.load());
+}
+
+int main(int argc, char *argv[]) {
 	try {
 		std::cout << "Insert test..." << std::endl;
 		test_insert();
@@ -577,6 +3979,54 @@ int main() {
 		std::cout << "Big sequential test..." << std::endl;
 		test_random(50'000, SEQ);
 
+		std::cout << "Heterogeneous test..." << std::endl;
+		test_heterogeneous();
+
+		std::cout << "Move only test..." << std::endl;
+		test_move_only();
+
+		std::cout << "Slab test..." << std::endl;
+		test_slab();
+
+		std::cout << "Sorted test..." << std::endl;
+		test_sorted<Tree<size_t>>();
+		test_sorted<SlabTree>();
+
+		std::cout << "Range test..." << std::endl;
+		test_ranges();
+
+		std::cout << "Order statistics test..." << std::endl;
+		test_order_statistics<SizedTree>();
+		test_order_statistics<Tree<size_t, std::less<size_t>, SlabNodes<64>, SubtreeSizes>>();
+
+		std::cout << "Aggregate test..." << std::endl;
+		test_aggregates();
+
+		std::cout << "Set operations test..." << std::endl;
+		test_set_operations<Tree<size_t>>();
+		test_set_operations<Tree<size_t, std::less<size_t>, SlabNodes<64>>>();
+
+		std::cout << "B-tree test..." << std::endl;
+		test_btrees();
+
+		std::cout << "Concurrent test..." << std::endl;
+		test_concurrent();
+
+		// the benchmarks take minutes, they run only when asked for
+		if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+			benchmark_find();
+			benchmark_payloads();
+			benchmark_nodes();
+			benchmark_sorted();
+			benchmark_set_operations();
+			benchmark_ranges();
+			benchmark_order_statistics();
+			benchmark_aggregates();
+			benchmark_concurrent();
+			benchmark_btree();
+			benchmark_retrace();
+		}
+
 		std::cout << "All tests passed." << std::endl;
 	} catch (const TestFailed &e) {
 		std::cout << "Test failed: " << e.what() << std::endl;
@@ -3,6 +3,7 @@
 #include <array>
 #include <bitset>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <deque>
 #include <iomanip>
@@ -14,6 +15,7 @@
 #include <queue>
 #include <random>
 #include <stack>
+#include <string>
 #include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
@@ -34,9 +36,12 @@ struct TextEditorBackend {
 		size_t m_lineCount;
 		// * node value variables
 		char m_value;
+		// * multi-cursor variables
+		bool m_hasCursor;
 
 		Node(char value) : m_value(value) {
 			// sanity check
+			m_hasCursor = false;
 			m_parent = nullptr;
 			m_leftChild = nullptr;
 			m_rightChild = nullptr;
@@ -65,12 +70,11 @@ struct TextEditorBackend {
 				m_lineCount += m_rightChild->m_lineCount;
 			}
 		}
-
-		void swapNodes(Node &other) {
-			std::swap(m_value, other.m_value);
-		}
 	};
 	Node *m_root;
+	// cursors of the multi-cursor editing, each one is a handle of the node it stands before (nullptr stands for the end of the text)
+	// they are kept sorted by their position and without duplicates
+	std::vector<Node *> m_cursors;
 
 	TextEditorBackend(const std::string &text) {
 		// naive implementation
@@ -275,19 +279,24 @@ struct TextEditorBackend {
 			m_root = subChild;
 		}
 	}
-	void erase(size_t index) {
-		// find the node
-		Node *toDelete = find(index);
+	void eraseNode(Node *toDelete) {
 		// case 1 - this node is not in tree - doesn't happen
-
+		Node *balanceFrom = toDelete->m_parent;
 		if (toDelete->m_leftChild && toDelete->m_rightChild) {
 			// case 4 - this node has two children
+			// the successor takes the place of the deleted node, so that nodes (and the cursors they hold) never change value
 			Node *min = findMin(toDelete->m_rightChild);
-			toDelete->swapNodes(*min);
-			toDelete = min;
-		}
-
-		if (!toDelete->m_leftChild && !toDelete->m_rightChild) {
+			balanceFrom = min;
+			if (min->m_parent != toDelete) {
+				balanceFrom = min->m_parent;
+				eraseSubMethod(min, min->m_rightChild);
+				min->m_rightChild = toDelete->m_rightChild;
+				min->m_rightChild->m_parent = min;
+			}
+			min->m_leftChild = toDelete->m_leftChild;
+			min->m_leftChild->m_parent = min;
+			eraseSubMethod(toDelete, min);
+		} else if (!toDelete->m_leftChild && !toDelete->m_rightChild) {
 			// case 2 - this node is a leaf
 			eraseSubMethod(toDelete, nullptr);
 		} else if (toDelete->m_leftChild && !toDelete->m_rightChild) {
@@ -299,10 +308,178 @@ struct TextEditorBackend {
 			eraseSubMethod(toDelete, toDelete->m_rightChild);
 		}
 
-		Node *balanceFrom = toDelete->m_parent;
 		delete toDelete;
 		balance(balanceFrom);
 	}
+	void erase(size_t index) {
+		// find the node
+		Node *toDelete = find(index);
+		if (toDelete->m_hasCursor) {
+			// the cursor standing before the deleted character now stands before the next one, unless a cursor already does
+			Node *next = successor(toDelete);
+			auto it = lowerCursor(index);
+			if (it + 1 != m_cursors.end() && *(it + 1) == next) {
+				m_cursors.erase(it);
+			} else {
+				*it = next;
+			}
+			if (next) {
+				next->m_hasCursor = true;
+			}
+		}
+		eraseNode(toDelete);
+	}
+
+	// * multi-cursor editing
+	Node *successor(Node *n) const {
+		if (n->m_rightChild) {
+			return findMin(n->m_rightChild);
+		}
+		while (n->m_parent && n->m_parent->m_rightChild == n) {
+			n = n->m_parent;
+		}
+		return n->m_parent;
+	}
+	// Returns the node before the handle, nullptr stands for the end of the text
+	Node *predecessor(Node *n) const {
+		if (!n) {
+			return findMax(m_root);
+		}
+		if (n->m_leftChild) {
+			return findMax(n->m_leftChild);
+		}
+		while (n->m_parent && n->m_parent->m_leftChild == n) {
+			n = n->m_parent;
+		}
+		return n->m_parent;
+	}
+	// Returns the index of the handle, nullptr stands for the end of the text
+	size_t indexOf(const Node *n) const {
+		if (!n) {
+			return size();
+		}
+		size_t index = getSize(n->m_leftChild);
+		while (n->m_parent) {
+			if (n->m_parent->m_rightChild == n) {
+				index += getSize(n->m_parent->m_leftChild) + 1;
+			}
+			n = n->m_parent;
+		}
+		return index;
+	}
+	// Inserts the value before the handle without looking up its index
+	void insertBefore(Node *handle, char value) {
+		Node *toInsert = new Node(value);
+		if (!m_root) {
+			m_root = toInsert;
+			return;
+		}
+		if (handle && !handle->m_leftChild) {
+			toInsert->m_parent = handle;
+			handle->m_leftChild = toInsert;
+		} else {
+			// the new node is the right-most node of the subtree before the handle
+			toInsert->m_parent = findMax(handle ? handle->m_leftChild : m_root);
+			toInsert->m_parent->m_rightChild = toInsert;
+		}
+		balance(toInsert->m_parent);
+	}
+
+	// The first cursor not before the index, O(log c log n)
+	std::vector<Node *>::iterator lowerCursor(size_t index) {
+		return std::lower_bound(m_cursors.begin(), m_cursors.end(), index, [this](const Node *cursor, size_t i) { return indexOf(cursor) < i; });
+	}
+
+	size_t cursors() const {
+		return m_cursors.size();
+	}
+	// Returns the current index of the i-th cursor, cursors are ordered by their position
+	size_t cursor_position(size_t cursorIndex) const {
+		if (cursorIndex >= cursors())
+			throw std::out_of_range("Cursor index is outside [0, cursors())");
+		return indexOf(m_cursors[cursorIndex]);
+	}
+	// Places a cursor before the i-th character, a cursor on an already occupied position is ignored
+	// O(log c log n) to find the place and O(c) to shift the later cursors, many cursors are placed faster by add_cursors
+	void add_cursor(size_t index) {
+		if (index > size())
+			throw std::out_of_range("Index is not inside [0, size()]");
+		Node *handle = index == size() ? nullptr : find(index);
+		auto it = lowerCursor(index);
+		if (it != m_cursors.end() && *it == handle) {
+			return;
+		}
+		m_cursors.insert(it, handle);
+		if (handle) {
+			handle->m_hasCursor = true;
+		}
+	}
+	// Places cursors before the characters of the sorted indices, in O((c + k) log n) for k indices
+	// The new cursors are merged with the existing ones in one pass, occupied positions are ignored
+	void add_cursors(const std::vector<size_t> &indices) {
+		for (size_t i = 0; i < indices.size(); ++i) {
+			if (indices[i] > size())
+				throw std::out_of_range("Index is not inside [0, size()]");
+			if (i > 0 && indices[i] < indices[i - 1])
+				throw std::invalid_argument("Indices are not sorted");
+		}
+		std::vector<Node *> merged;
+		merged.reserve(m_cursors.size() + indices.size());
+		size_t next = 0; // of the existing cursors
+		size_t nextIndex = next < m_cursors.size() ? indexOf(m_cursors[next]) : 0;
+		auto add = [&merged](Node *handle) {
+			if (merged.empty() || merged.back() != handle) {
+				merged.push_back(handle);
+			}
+		};
+		for (size_t index : indices) {
+			while (next < m_cursors.size() && nextIndex <= index) {
+				add(m_cursors[next]);
+				if (++next < m_cursors.size()) {
+					nextIndex = indexOf(m_cursors[next]);
+				}
+			}
+			Node *handle = index == size() ? nullptr : find(index);
+			if (handle) {
+				handle->m_hasCursor = true;
+			}
+			add(handle);
+		}
+		for (; next < m_cursors.size(); ++next) {
+			add(m_cursors[next]);
+		}
+		m_cursors.swap(merged);
+	}
+	void clear_cursors() {
+		for (Node *cursor : m_cursors) {
+			if (cursor) {
+				cursor->m_hasCursor = false;
+			}
+		}
+		m_cursors.clear();
+	}
+	// Types the character at every cursor, the cursors end up after the inserted characters
+	void insert_at_cursors(char value) {
+		for (Node *cursor : m_cursors) {
+			insertBefore(cursor, value);
+		}
+	}
+	// Erases the character before every cursor (a backspace), cursors at the start of the text do nothing
+	void erase_at_cursors() {
+		// going from the last cursor, the cursors after the visited one are never affected by its backspace
+		for (size_t i = m_cursors.size(); i-- > 0;) {
+			Node *toDelete = predecessor(m_cursors[i]);
+			if (!toDelete) {
+				continue;
+			}
+			// only the previous cursor can stand before the deleted character, it moves to this cursor
+			if (i > 0 && m_cursors[i - 1] == toDelete) {
+				m_cursors[i - 1] = m_cursors[i];
+			}
+			eraseNode(toDelete);
+		}
+		m_cursors.erase(std::unique(m_cursors.begin(), m_cursors.end()), m_cursors.end());
+	}
 
 	// Returns the index of the start of the i-th line
 	size_t line_start(size_t lineIndex) const {
@@ -515,6 +692,121 @@ char randChar(std::mt19937 &rand) {
 	return chars[rand() % 10];
 }
 
+void test_multi_cursor(int &ok, int &fail) {
+	TextEditorBackend t("123\n456\n789");
+	std::vector<size_t> starts;
+	for (size_t r = 0; r < t.lines(); ++r)
+		starts.push_back(t.line_start(r));
+	t.add_cursors(starts);
+	t.add_cursor(4); // already there
+	t.add_cursors({4, 8}); // already there
+	CHECK(t.cursors(), 3);
+	CHECK_ALL(t.cursor_position, 0, 4, 8);
+
+	t.insert_at_cursors('#');
+	CHECK(text(t), "#123\n#456\n#789");
+	CHECK_ALL(t.cursor_position, 1, 6, 11);
+	t.insert_at_cursors('\n');
+	CHECK(text(t), "#\n123\n#\n456\n#\n789");
+	CHECK(t.lines(), 6);
+	CHECK_ALL(t.line_start, 0, 2, 6, 8, 12, 14);
+
+	t.erase_at_cursors();
+	t.erase_at_cursors();
+	CHECK(text(t), "123\n456\n789");
+	CHECK_ALL(t.cursor_position, 0, 4, 8);
+	t.erase_at_cursors(); // the first cursor is at the start of the text
+	CHECK(text(t), "123456789");
+	CHECK_ALL(t.cursor_position, 0, 3, 6);
+
+	// cursors meet when the characters between them are erased
+	t.clear_cursors();
+	t.add_cursor(1);
+	t.add_cursor(2);
+	t.add_cursor(t.size());
+	t.erase_at_cursors();
+	CHECK(text(t), "345678");
+	CHECK(t.cursors(), 2);
+	CHECK_ALL(t.cursor_position, 0, 6);
+	t.erase_at_cursors();
+	CHECK(text(t), "34567");
+	CHECK_ALL(t.cursor_position, 0, 5);
+
+	// plain erase of the character after a cursor moves the cursor to the next one
+	t.erase(0);
+	CHECK(text(t), "4567");
+	CHECK_ALL(t.cursor_position, 0, 4);
+	t.insert_at_cursors('x');
+	CHECK(text(t), "x4567x");
+
+	CHECK_EX(t.add_cursor(8), std::out_of_range);
+	CHECK_EX(t.add_cursors({1, 8}), std::out_of_range);
+	CHECK_EX(t.add_cursors({2, 1}), std::invalid_argument);
+	CHECK_EX(t.cursor_position(2), std::out_of_range);
+}
+
+void test_multi_cursor_random(int &ok, int &fail, size_t size = 2'000) {
+	std::mt19937 my_rand(24707 + size);
+	std::string ref;
+	for (size_t i = 0; i < size; ++i)
+		ref.push_back(randChar(my_rand));
+	TextEditorBackend t(ref);
+	std::vector<size_t> positions; // reference cursors
+
+	for (size_t round = 0; round < 200; ++round) {
+		if (round % 20 == 0) {
+			t.clear_cursors();
+			positions.clear();
+			// half one by one, half in a batch merged with them
+			for (size_t i = 0; i < 25; ++i) {
+				size_t where = my_rand() % (ref.size() + 1);
+				t.add_cursor(where);
+				positions.push_back(where);
+			}
+			std::vector<size_t> batch;
+			for (size_t i = 0; i < 25; ++i)
+				batch.push_back(my_rand() % (ref.size() + 1));
+			std::sort(batch.begin(), batch.end());
+			t.add_cursors(batch);
+			positions.insert(positions.end(), batch.begin(), batch.end());
+			std::sort(positions.begin(), positions.end());
+			positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+		}
+		if (my_rand() % 4 == 0 && !ref.empty()) {
+			// a plain erase moves the cursor before the erased character to the next one
+			size_t erased = my_rand() % ref.size();
+			t.erase(erased);
+			ref.erase(erased, 1);
+			for (size_t &position : positions)
+				position -= position > erased ? 1 : 0;
+			positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+		} else if (my_rand() % 3) {
+			char what = randChar(my_rand);
+			t.insert_at_cursors(what);
+			for (size_t i = 0; i < positions.size(); ++i) {
+				ref.insert(ref.begin() + positions[i] + i, what);
+				positions[i] += i + 1;
+			}
+		} else {
+			t.erase_at_cursors();
+			for (size_t i = positions.size(); i-- > 0;) {
+				if (positions[i] == 0)
+					continue;
+				size_t erased = positions[i] - 1;
+				ref.erase(erased, 1);
+				for (size_t &position : positions)
+					position -= position > erased ? 1 : 0;
+			}
+			positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+		}
+	}
+	CHECK(text(t), ref);
+	CHECK(t.cursors(), positions.size());
+	for (size_t i = 0; i < positions.size() && i < t.cursors(); ++i)
+		CHECK(t.cursor_position(i), positions[i]);
+	CHECK(t.lines(), (size_t)std::count(ref.begin(), ref.end(), '\n') + 1);
+}
+
 void myTest(size_t size = 1'000'000) {
 	std::mt19937 my_rand(24707 + size);
 	std::string ref;
@@ -557,7 +849,138 @@ void myTest(size_t size = 1'000'000) {
 	}
 }
 
-int main() {
+enum BenchmarkMix : unsigned {
+	TYPING,		   // bursts of consecutive inserts at a wandering cursor, with an occasional backspace
+	RANDOM_ACCESS, // at and edit on uniformly random positions
+	LINE_QUERIES,  // line_start, line_length and char_to_line on random lines / characters
+	MIXED		   // the same mix as myTest, inserts, edits and erases on random positions
+};
+
+const char *benchmarkMixName(BenchmarkMix mix) {
+	switch (mix) {
+		case TYPING:
+			return "typing";
+		case RANDOM_ACCESS:
+			return "random access";
+		case LINE_QUERIES:
+			return "line queries";
+		default:
+			return "mixed";
+	}
+}
+
+// Replays `operations` operations of the given mix against an editor pre-filled with `documentSize` characters.
+// Every operation is timed separately, so that the tail latency of rebalancing shows up in the percentiles.
+void benchmark(BenchmarkMix mix, size_t documentSize, size_t operations = 1'000'000) {
+	using Clock = std::chrono::steady_clock;
+	std::mt19937 my_rand(24707 + documentSize);
+
+	std::string initial(documentSize, 'a');
+	for (char &ch : initial)
+		ch = randChar(my_rand);
+
+	Clock::time_point buildStart = Clock::now();
+	TextEditorBackend t(initial);
+	double buildTime = std::chrono::duration<double>(Clock::now() - buildStart).count();
+	initial.clear();
+	initial.shrink_to_fit();
+
+	std::vector<uint64_t> latencies; // in nanoseconds
+	latencies.reserve(operations);
+	size_t cursor = t.size() / 2;
+	size_t sink = 0; // results of queries, so that the compiler cannot throw them away
+
+	Clock::time_point runStart = Clock::now();
+	for (size_t i = 0; i < operations; ++i) {
+		// choose the operation and its arguments before the clock starts
+		size_t where = 0;
+		char what = randChar(my_rand);
+		unsigned op = my_rand() % 16;
+		switch (mix) {
+			case TYPING:
+				if (i % 64 == 0) // move the cursor to start a new burst
+					cursor = my_rand() % (t.size() + 1);
+				break;
+			case RANDOM_ACCESS:
+				where = t.size() ? my_rand() % t.size() : 0;
+				break;
+			case LINE_QUERIES:
+				where = op % 3 == 2 ? (t.size() ? my_rand() % t.size() : 0) : my_rand() % t.lines();
+				break;
+			default:
+				where = my_rand() % (t.size() + 1);
+				break;
+		}
+
+		Clock::time_point opStart = Clock::now();
+		switch (mix) {
+			case TYPING:
+				if (op == 0 && cursor > 0) { // backspace
+					t.erase(--cursor);
+				} else {
+					t.insert(cursor++, what);
+				}
+				break;
+			case RANDOM_ACCESS:
+				if (!t.size())
+					break;
+				if (op < 12) {
+					sink += t.at(where);
+				} else {
+					t.edit(where, what);
+				}
+				break;
+			case LINE_QUERIES:
+				if (op % 3 == 0) {
+					sink += t.line_start(where);
+				} else if (op % 3 == 1) {
+					sink += t.line_length(where);
+				} else if (t.size()) {
+					sink += t.char_to_line(where);
+				}
+				break;
+			default:
+				if (op < 3 && where < t.size()) {
+					t.erase(where);
+				} else if (op < 6 && where < t.size()) {
+					t.edit(where, what);
+				} else {
+					t.insert(where, what);
+				}
+				break;
+		}
+		latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - opStart).count());
+	}
+	double runTime = std::chrono::duration<double>(Clock::now() - runStart).count();
+
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&latencies](double p) -> uint64_t {
+		if (latencies.empty())
+			return 0;
+		return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+	};
+
+	std::cout << std::setw(14) << benchmarkMixName(mix)
+			  << " | size " << std::setw(10) << documentSize
+			  << " | build " << std::fixed << std::setprecision(3) << buildTime << " s"
+			  << " | " << std::setprecision(0) << (runTime > 0 ? operations / runTime : 0) << " ops/s"
+			  << " | p50 " << percentile(0.5) << " ns"
+			  << " | p99 " << percentile(0.99) << " ns"
+			  << " | p999 " << percentile(0.999) << " ns"
+			  << " | max " << (latencies.empty() ? 0 : latencies.back()) << " ns"
+			  << " | checksum " << sink << std::endl;
+	std::cout.unsetf(std::ios_base::floatfield);
+}
+
+void benchmarkAll(size_t maxDocumentSize = 100'000'000) {
+	for (size_t documentSize = 1'000; documentSize <= maxDocumentSize; documentSize *= 10) {
+		for (BenchmarkMix mix : {TYPING, RANDOM_ACCESS, LINE_QUERIES, MIXED}) {
+			benchmark(mix, documentSize);
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
 	int ok = 0, fail = 0;
 	if (!fail)
 		test1(ok, fail);
@@ -567,6 +990,10 @@ int main() {
 		test3(ok, fail);
 	if (!fail)
 		test_ex(ok, fail);
+	if (!fail)
+		test_multi_cursor(ok, fail);
+	if (!fail)
+		test_multi_cursor_random(ok, fail);
 
 	if (!fail)
 		std::cout << "Passed all " << ok << " tests!" << std::endl;
@@ -574,6 +1001,9 @@ int main() {
 		std::cout << "Failed " << fail << " of " << (ok + fail) << " tests." << std::endl;
 
 	// myTest();
+	// the benchmarks take minutes, they run only when asked for
+	if (argc > 1 && std::string(argv[1]) == "--benchmark")
+		benchmarkAll();
 }
 
 #endif
@@ -1,26 +1,39 @@
 #ifndef __PROGTEST__
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bitset>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <deque>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <queue>
 #include <random>
 #include <set>
 #include <stack>
+#include <string>
+#include <thread>
 #include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using Price = unsigned long long;
 using Employee = size_t;
 inline constexpr Employee NO_EMPLOYEE = -1;
@@ -28,6 +41,10 @@ using Gift = size_t;
 
 #endif
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h> // vectorized kernel, it is used only if the processor supports it
+#endif
+
 // I will call the employee with no boss a supreme boss
 // Each employee has only one or no boss
 // 1. If the employee has no boss, he is the supreme boss
@@ -43,163 +60,1437 @@ using Gift = size_t;
 // * https://dl.acm.org/doi/10.1145/75427.75430
 // The sum of these minimal sums will be the cheapest way to give presents to the employees.
 
-struct Vertex {
-	Employee parent;
-	Gift totalBestColor;
-
-	// two colorings, in case it is better for the parent to use this node's first best color
-	Gift firstBestColor;
-	Price minSum;
-	Gift secondBestColor;
-	Price minSum2;
+// Two colorings of the sub-tree of a vertex, in case it is better for the parent to use this node's first best color.
+// The sums and the colors are in separate arrays, so that the colors can be as narrow as the number of gifts allows.
+struct Sums {
+	Price minSum = 0;
+	Price minSum2 = 0;
+};
 
-	Vertex(const Employee &emp) : parent(emp) {
-		minSum = 0;
-		firstBestColor = 0;
-		minSum2 = 0;
-		secondBestColor = 0;
-	}
+template <typename Color>
+struct BestColors {
+	Color firstBestColor = 0;
+	Color secondBestColor = 0;
 };
 
-class Graph {
-private:
-	std::vector<Employee> m_roots;						  // indexes of roots of trees
-	std::vector<Vertex> m_vertices;						  // all vertices and important information for the minimal sum coloring of a tree algorithm
-	std::map<Employee, std::vector<Employee>> m_children; // directed edges to children
-	std::vector<std::pair<Gift, Price>> m_gifts;		  // available gifts/colors
+// Kernels choosing the two best colors of a vertex. The cost of each candidate color is its price plus the minimal sums of the children
+// plus its correction, prices and corrections are gathered by the color. Ties are broken by the lower color, as in a scan of all gifts.
+// The AVX-512 version is chosen at runtime if the processor supports it.
+namespace kernels {
+	struct BestTwo {
+		size_t first; // positions in the candidate colors
+		size_t second;
+		Price min1;
+		Price min2;
+	};
 
-	std::vector<Employee> getPostorder(Employee root) {
-		std::vector<Employee> preorder;
-		std::stack<Employee> toVisit;
+	// number of candidates from which the vectorized kernel is used, below it the call and the merge of the lanes cost more than they save
+	inline constexpr size_t MIN_VECTORIZED = 64;
 
-		toVisit.push(root);
-		while (!toVisit.empty()) {
-			Employee visiting = toVisit.top();
-			toVisit.pop();
-			preorder.push_back(visiting);
-			for (Employee child : m_children[visiting]) {
-				toVisit.push(child);
+	using BestTwoKernel = BestTwo (*)(const Price *prices, const Price *corrections, Price base, const Gift *colors, size_t count);
+
+	inline BestTwo bestTwoScalar(const Price *prices, const Price *corrections, Price base, const Gift *colors, size_t count) {
+		BestTwo best = {0, 0, std::numeric_limits<Price>::max(), std::numeric_limits<Price>::max()};
+		Gift color1 = std::numeric_limits<Gift>::max(), color2 = color1;
+		for (size_t i = 0; i < count; ++i) {
+			Price cost = prices[colors[i]] + base + corrections[colors[i]];
+			if (cost < best.min1 || (cost == best.min1 && colors[i] < color1)) {
+				best.min2 = best.min1;
+				best.second = best.first;
+				color2 = color1;
+				best.min1 = cost;
+				best.first = i;
+				color1 = colors[i];
+			} else if (cost < best.min2 || (cost == best.min2 && colors[i] < color2)) {
+				best.min2 = cost;
+				best.second = i;
+				color2 = colors[i];
+			}
+		}
+		return best;
+	}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	// Adds a cost to the best two, ties go to the lower color like in the scalar kernel
+	inline void offer(BestTwo &best, Price cost, size_t position, const Gift *colors) {
+		if (cost < best.min1 || (cost == best.min1 && colors[position] < colors[best.first])) {
+			best.min2 = best.min1;
+			best.second = best.first;
+			best.min1 = cost;
+			best.first = position;
+		} else if (cost < best.min2 || (cost == best.min2 && colors[position] < colors[best.second])) {
+			best.min2 = cost;
+			best.second = position;
+		}
+	}
+
+	// Merges the two best costs of every lane, lanes which have not seen a candidate hold the maximum
+	inline BestTwo mergeLanes(const Price *min1, const Price *min2, const Price *pos1, const Price *pos2, size_t lanes, const Gift *colors) {
+		BestTwo best = {0, 0, std::numeric_limits<Price>::max(), std::numeric_limits<Price>::max()};
+		for (size_t i = 0; i < lanes; ++i) {
+			if (min1[i] != std::numeric_limits<Price>::max()) {
+				offer(best, min1[i], pos1[i], colors);
 			}
+			if (min2[i] != std::numeric_limits<Price>::max()) {
+				offer(best, min2[i], pos2[i], colors);
+			}
+		}
+		return best;
+	}
+
+	// Every lane keeps its own two best costs in a single pass, so that the costs never have to be stored and searched again.
+	// There is no AVX2 version, its gathers and the emulated unsigned comparisons made it slower than the scalar kernel.
+	[[gnu::target("avx512f")]] BestTwo bestTwoAvx512(const Price *prices, const Price *corrections, Price base, const Gift *colors, size_t count) {
+		const __m512i baseVector = _mm512_set1_epi64(base);
+		__m512i min1 = _mm512_set1_epi64(-1), min2 = min1;
+		__m512i pos1 = _mm512_setzero_si512(), pos2 = pos1;
+		__m512i color1 = _mm512_set1_epi64(-1), color2 = color1;
+		__m512i position = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m512i step = _mm512_set1_epi64(8);
+		for (size_t i = 0; i < count; i += 8, position = _mm512_add_epi64(position, step)) {
+			__mmask8 lanes = count - i >= 8 ? 0xFF : (__mmask8)((1u << (count - i)) - 1);
+			__m512i color = _mm512_maskz_loadu_epi64(lanes, colors + i);
+			__m512i price = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), lanes, color, prices, 8);
+			__m512i correction = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), lanes, color, corrections, 8);
+			__m512i cost = _mm512_add_epi64(_mm512_add_epi64(price, correction), baseVector);
+			// (cost, color) is less than (min, its color)
+			__mmask8 less1 = _mm512_mask_cmplt_epu64_mask(lanes, cost, min1)
+							 | _mm512_mask_cmplt_epu64_mask(_mm512_mask_cmpeq_epu64_mask(lanes, cost, min1), color, color1);
+			__mmask8 less2 = _mm512_mask_cmplt_epu64_mask(lanes, cost, min2)
+							 | _mm512_mask_cmplt_epu64_mask(_mm512_mask_cmpeq_epu64_mask(lanes, cost, min2), color, color2);
+			min2 = _mm512_mask_mov_epi64(_mm512_mask_mov_epi64(min2, less2, cost), less1, min1);
+			pos2 = _mm512_mask_mov_epi64(_mm512_mask_mov_epi64(pos2, less2, position), less1, pos1);
+			color2 = _mm512_mask_mov_epi64(_mm512_mask_mov_epi64(color2, less2, color), less1, color1);
+			min1 = _mm512_mask_mov_epi64(min1, less1, cost);
+			pos1 = _mm512_mask_mov_epi64(pos1, less1, position);
+			color1 = _mm512_mask_mov_epi64(color1, less1, color);
 		}
+		alignas(64) Price lanes[4 * 8];
+		_mm512_store_si512(lanes, min1);
+		_mm512_store_si512(lanes + 8, min2);
+		_mm512_store_si512(lanes + 16, pos1);
+		_mm512_store_si512(lanes + 24, pos2);
+		return mergeLanes(lanes, lanes + 8, lanes + 16, lanes + 24, 8, colors);
+	}
+#endif
 
-		std::reverse(preorder.begin(), preorder.end());
-		return preorder;
+	enum Level {
+		SCALAR,
+		AVX512
+	};
+
+	// The best level supported by the processor
+	Level detect() {
+#if defined(__x86_64__) && defined(__GNUC__)
+		if (__builtin_cpu_supports("avx512f")) {
+			return AVX512;
+		}
+#endif
+		return SCALAR;
+	}
+
+	BestTwoKernel bestTwo(Level level) {
+#if defined(__x86_64__) && defined(__GNUC__)
+		if (level == AVX512) {
+			return bestTwoAvx512;
+		}
+#endif
+		return bestTwoScalar;
 	}
+}
 
-	void colorTree(Employee root) {
-		std::vector<Employee> order = getPostorder(root); // linear traversal of entire tree, leaves first, then their parents, etc.
+// The threads are not available on Progtest, so the pool and the parallel solvers are only compiled locally
+#ifndef __PROGTEST__
+// A pool of threads, each with its own queue of tasks. A thread takes the newest task from its own queue,
+// and when it runs out of them, it steals the oldest task of another thread, which tends to be the biggest one.
+template <typename Task>
+class WorkStealingPool {
+private:
+	struct Queue {
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+	std::vector<Queue> m_queues;
+	std::atomic<size_t> m_pending; // tasks pushed and not yet finished, the pool stops once there are none
 
-		for (size_t i = 0; i < order.size(); ++i) {
-			Employee visiting = order[i];
-			if (m_children[visiting].size() == 0) { // base case
-				// since the gift array is sorted, the best two colorings must be these
-				m_vertices[visiting].firstBestColor = 0;
-				m_vertices[visiting].secondBestColor = 1;
-				m_vertices[visiting].minSum = m_gifts[0].second;
-				m_vertices[visiting].minSum2 = m_gifts[1].second;
+	std::optional<Task> take(size_t worker) {
+		for (size_t i = 0; i < m_queues.size(); ++i) {
+			Queue &queue = m_queues[(worker + i) % m_queues.size()];
+			std::lock_guard<std::mutex> guard(queue.lock);
+			if (queue.tasks.empty()) {
 				continue;
 			}
+			Task task = i == 0 ? queue.tasks.back() : queue.tasks.front();
+			if (i == 0) {
+				queue.tasks.pop_back();
+			} else {
+				queue.tasks.pop_front();
+			}
+			return task;
+		}
+		return std::nullopt;
+	}
 
-			std::vector<Price> allColoring; // what would the minimal sum of sub-tree be if we insist on coloring this vertex with a color
-			for (size_t k = 0; k < m_gifts.size(); ++k) {
-				Price p = m_gifts[k].second;
-				for (Employee emp : m_children[visiting]) {
-					p += (m_vertices[emp].firstBestColor != k) ? m_vertices[emp].minSum : m_vertices[emp].minSum2;
-				}
-				allColoring.push_back(p);
-			}
-
-			// get the two minimums of this sub-tree
-			size_t pos1 = 0;
-			size_t pos2 = 1;
-			size_t min1 = allColoring[0];
-			size_t min2 = allColoring[1];
-			if (min2 < min1) {
-				std::swap(pos1, pos2);
-				std::swap(min1, min2);
-			}
-			for (size_t k = 2; k < m_gifts.size(); ++k) {
-				if (allColoring[k] < min1) {
-					min2 = min1;
-					pos2 = pos1;
-					min1 = allColoring[k];
-					pos1 = k;
+public:
+	WorkStealingPool(size_t workers) : m_queues(workers), m_pending(0) {}
+
+	size_t workers() const {
+		return m_queues.size();
+	}
+
+	// Can also be called by the tasks, the new task is then stolen only if the worker is too busy to take it first
+	void push(size_t worker, const Task &task) {
+		m_pending.fetch_add(1);
+		std::lock_guard<std::mutex> guard(m_queues[worker].lock);
+		m_queues[worker].tasks.push_back(task);
+	}
+
+	bool idle(size_t worker) {
+		std::lock_guard<std::mutex> guard(m_queues[worker].lock);
+		return m_queues[worker].tasks.empty();
+	}
+
+	// Runs all tasks, calling run(task, worker) for each of them, returns once all tasks are finished
+	template <typename Run>
+	void run(Run run) {
+		auto work = [this, &run](size_t worker) {
+			while (m_pending.load() > 0) {
+				std::optional<Task> task = take(worker);
+				if (!task) {
+					std::this_thread::yield();
 					continue;
 				}
-				if (allColoring[k] < min2) {
-					min2 = allColoring[k];
-					pos2 = k;
-				}
+				run(*task, worker);
+				m_pending.fetch_sub(1);
 			}
-			m_vertices[visiting].firstBestColor = pos1;
-			m_vertices[visiting].minSum = min1;
-			m_vertices[visiting].secondBestColor = pos2;
-			m_vertices[visiting].minSum2 = min2;
+		};
+		std::vector<std::thread> threads;
+		for (size_t worker = 1; worker < m_queues.size(); ++worker) {
+			threads.emplace_back(work, worker);
+		}
+		work(0);
+		for (std::thread &thread : threads) {
+			thread.join();
 		}
+	}
+};
+#endif
+
+// The structure of the forest of employees. It does not depend on the prices of the gifts, so more colorings can share it.
+// The vertices are renumbered in the breadth first order of the forest, so that the children of a vertex are next to each other and after it,
+// the coloring is then a sweep from the last vertex to the first one and the tracing a sweep back, both reading the memory in order.
+// Vertices are 32-bit numbers, which halves the memory of the forest.
+struct Forest {
+	using Index = uint32_t;
+	static constexpr Index NO_VERTEX = std::numeric_limits<Index>::max();
 
-		std::reverse(order.begin(), order.end()); // reverse the postorder to get preorder
-		// trace back all results
-		for (size_t i = 0; i < order.size(); ++i) {
-			Employee visiting = order[i];
-			if (m_vertices[visiting].parent == NO_EMPLOYEE) { // since the supreme boss has no bosses, the first best color must be the total best color
-				m_vertices[visiting].totalBestColor = m_vertices[visiting].firstBestColor;
+	size_t rootCount = 0;			  // roots of trees are the first vertices
+	std::vector<Index> parent;		  // the boss of each vertex, only the parallel coloring needs it
+	std::vector<Index> childrenStart; // children of vertex v are vertices childrenStart[v] to childrenStart[v + 1] - 1
+	std::vector<Index> original;	  // the employee of each vertex
+	// children by the original numbers of the employees, used only while renumbering
+	std::vector<Index> children;
+	std::vector<Index> fill;
+
+	size_t size() const {
+		return parent.size();
+	}
+
+	size_t childCount(Employee v) const {
+		return childrenStart[v + 1] - childrenStart[v];
+	}
+
+	// Replaces the forest, the memory of the previous one is reused
+	void init(const std::vector<Employee> &boss) {
+		init(boss.data(), boss.size());
+	}
+
+	// The bosses may be of any unsigned type, e.g. mapped from a file, and its maximum means no boss
+	// Throws if a boss is not an employee, or if some employees are not under a supreme boss, because the bosses have a cycle
+	template <typename Boss>
+	void init(const Boss *boss, size_t n) {
+		static_assert(std::is_unsigned_v<Boss>);
+		const Boss noBoss = std::numeric_limits<Boss>::max();
+		if (n >= NO_VERTEX) {
+			throw std::length_error("too many employees");
+		}
+		parent.clear();
+		original.clear();
+		parent.reserve(n);
+		original.reserve(n);
+		childrenStart.assign(n + 1, 0);
+		for (Employee emp = 0; emp < n; ++emp) {
+			if (boss[emp] == noBoss) {
+				parent.push_back(NO_VERTEX);
+				original.push_back(emp);
 				continue;
 			}
-			// this employee has a boss, so if the boss's total best color is the same as the first best color of this employee, the employee must use the second best color
+			if (boss[emp] >= n) {
+				throw std::invalid_argument("boss is not an employee");
+			}
+			++childrenStart[boss[emp] + 1];
+		}
+		rootCount = original.size();
+		// counting sort of the employees by their boss - prefix sums of the child counts are the starts of the groups
+		for (Employee emp = 0; emp < n; ++emp) {
+			childrenStart[emp + 1] += childrenStart[emp];
+		}
+		children.resize(n - rootCount);
+		fill.assign(childrenStart.begin(), childrenStart.end() - 1); // next free position in each group
+		for (Employee emp = 0; emp < n; ++emp) {
+			if (boss[emp] != noBoss) {
+				children[fill[boss[emp]]++] = emp;
+			}
+		}
+		// breadth first renumbering, original is the queue, the children of a vertex get the next free numbers when it is taken from it
+		fill.clear();
+		for (Index v = 0; v < original.size(); ++v) {
+			Index emp = original[v];
+			fill.push_back(original.size());
+			for (Index i = childrenStart[emp]; i < childrenStart[emp + 1]; ++i) {
+				parent.push_back(v);
+				original.push_back(children[i]);
+			}
+		}
+		if (original.size() != n) {
+			throw std::invalid_argument("bosses have a cycle");
+		}
+		fill.push_back(original.size());
+		childrenStart.swap(fill);
+	}
+};
+
+// Colors are positions of the gifts sorted by their price, Color is the narrowest type which can hold all of them.
+// The coloring reads the sums and the best colors of the children, the tracing reads the best colors and writes the total best colors,
+// so each pass touches only the arrays it needs.
+template <typename Color>
+class BasicGraph {
+private:
+	// scratch space of colorVertex, one for each thread coloring the graph
+	struct Scratch {
+		std::vector<Price> correction;		   // the extra price of a color forced on children whose first best color it is
+		std::vector<Employee> correctionOwner; // the vertex for which the correction of a color was computed, so that it never has to be cleared
+		std::vector<Gift> candidates;		   // colors which can be the best ones, each one only once
+
+		void init(size_t colors) {
+			correction.assign(colors, 0);
+			correctionOwner.assign(colors, NO_EMPLOYEE);
+			// every color is a candidate at most once
+			candidates.reserve(colors);
+		}
+	};
+
+	Forest m_ownForest; // the forest built by init from the bosses, unused when the forest is shared
+	const Forest *m_forest = &m_ownForest;
+	// important information for the minimal sum coloring of a tree algorithm, in the order of the forest
+	std::vector<Sums> m_sums;
+	std::vector<BestColors<Color>> m_bestColors;
+	std::vector<Color> m_totalBestColor;
+	std::vector<std::pair<Gift, Price>> m_gifts; // available gifts/colors
+	std::vector<Price> m_prices;				 // prices of the colors, so that the kernels can gather them
+	kernels::BestTwoKernel m_bestTwo = kernels::bestTwo(kernels::detect());
+	// scratch space of the serial coloring, kept between the calls of init so that a reused graph does not allocate
+	Scratch m_scratch;
+
+	// Computes the two best colorings of the sub-tree of the vertex, its children must already be colored
+	// The cost of coloring the vertex with color k is the price of k, plus the minimal sums of all children,
+	// plus a correction of (minSum2 - minSum) for each child whose first best color is k.
+	// Only the first best colors of the children have a correction, and since the gifts are sorted, the best uncorrected colors are the two cheapest ones,
+	// so it is enough to check at most (number of children + 2) colors instead of all of them.
+	void colorVertex(Employee visiting, Scratch &scratch) {
+		if (m_forest->childCount(visiting) == 0) { // base case
+			// since the gift array is sorted, the best two colorings must be these
+			m_bestColors[visiting] = {0, 1};
+			m_sums[visiting] = {m_gifts[0].second, m_gifts[1].second};
+			return;
+		}
+
+		Price base = 0;
+		scratch.candidates.clear();
+		for (Employee i = m_forest->childrenStart[visiting]; i < m_forest->childrenStart[visiting + 1]; ++i) {
+			const Sums &child = m_sums[i];
+			Color color = m_bestColors[i].firstBestColor;
+			base += child.minSum;
+			if (scratch.correctionOwner[color] != visiting) {
+				scratch.correctionOwner[color] = visiting;
+				scratch.correction[color] = 0;
+				scratch.candidates.push_back(color);
+			}
+			scratch.correction[color] += child.minSum2 - child.minSum;
+		}
+		// the two cheapest uncorrected colors, with no correction
+		size_t found = 0;
+		for (Gift k = 0; k < m_gifts.size() && found < 2; ++k) {
+			if (scratch.correctionOwner[k] != visiting) {
+				scratch.correctionOwner[k] = visiting;
+				scratch.correction[k] = 0;
+				scratch.candidates.push_back(k);
+				++found;
+			}
+		}
+
+		// get the two minimums of this sub-tree, the vectorized kernel pays off only for more candidates
+		kernels::BestTwo best = scratch.candidates.size() < kernels::MIN_VECTORIZED
+									? kernels::bestTwoScalar(m_prices.data(), scratch.correction.data(), base, scratch.candidates.data(), scratch.candidates.size())
+									: m_bestTwo(m_prices.data(), scratch.correction.data(), base, scratch.candidates.data(), scratch.candidates.size());
+		m_bestColors[visiting] = {(Color)scratch.candidates[best.first], (Color)scratch.candidates[best.second]};
+		m_sums[visiting] = {best.min1, best.min2};
+	}
+
+	// Chooses the colors of the children of the vertex, the vertex must already have its color chosen
+	void traceChildren(Employee visiting) {
+		Color bossColor = m_totalBestColor[visiting];
+		for (Employee i = m_forest->childrenStart[visiting]; i < m_forest->childrenStart[visiting + 1]; ++i) {
+			// if the boss's total best color is the same as the first best color of this employee, the employee must use the second best color
 			// else, the total best color must be the first best color
-			m_vertices[visiting].totalBestColor = (m_vertices[visiting].firstBestColor != m_vertices[m_vertices[visiting].parent].totalBestColor) ? m_vertices[visiting].firstBestColor : m_vertices[visiting].secondBestColor;
+			const BestColors<Color> &colors = m_bestColors[i];
+			m_totalBestColor[i] = colors.firstBestColor != bossColor ? colors.firstBestColor : colors.secondBestColor;
+		}
+	}
+
+	// since the supreme bosses have no bosses, their first best colors must be their total best colors
+	void traceRoots() {
+		for (Employee root = 0; root < m_forest->rootCount; ++root) {
+			m_totalBestColor[root] = m_bestColors[root].firstBestColor;
 		}
 	}
 
 public:
-	Graph(const std::vector<Employee> &boss, const std::vector<Price> &gift_price) {
-		// Initialize graph
-		for (Employee emp = 0; emp < boss.size(); ++emp) {
-			m_vertices.emplace_back(boss[emp]);
-			if (m_children.find(emp) == m_children.end()) {
-				m_children.insert({emp, {}});
-			}
-			if (boss[emp] == NO_EMPLOYEE) {
-				m_roots.push_back(emp);
-				continue;
-			}
-			m_children[boss[emp]].push_back(emp);
+	BasicGraph() = default;
+
+	BasicGraph(const std::vector<Employee> &boss, const std::vector<Price> &gift_price) {
+		init(boss, gift_price);
+	}
+
+	// the graph may point to its own forest
+	BasicGraph(const BasicGraph &) = delete;
+	BasicGraph &operator=(const BasicGraph &) = delete;
+
+	// Replaces the graph, the memory of the previous one is reused
+	void init(const std::vector<Employee> &boss, const std::vector<Price> &gift_price) {
+		m_ownForest.init(boss);
+		init(m_ownForest, gift_price);
+	}
+
+	// Colors a shared forest with other prices, the forest must outlive the coloring
+	void init(const Forest &forest, const std::vector<Price> &gift_price) {
+		if (gift_price.size() > (size_t)std::numeric_limits<Color>::max() + 1) {
+			throw std::length_error("too many gifts for the colors of the graph");
 		}
+		m_forest = &forest;
+		// every vertex is overwritten by the coloring
+		m_sums.resize(forest.size());
+		m_bestColors.resize(forest.size());
+		m_totalBestColor.resize(forest.size());
+		m_gifts.clear();
 		// Initialize gifts
 		for (Gift gift = 0; gift < gift_price.size(); ++gift) {
 			m_gifts.push_back({gift, gift_price[gift]});
 		}
 		std::sort(m_gifts.begin(), m_gifts.end(), [](std::pair<Gift, Price> a, std::pair<Gift, Price> b) { return a.second < b.second; });
+		m_prices.clear();
+		for (const std::pair<Gift, Price> &gift : m_gifts) {
+			m_prices.push_back(gift.second);
+		}
+		m_scratch.init(m_gifts.size());
+	}
+
+	// Frees the memory kept for the next call of init
+	void release() {
+		m_ownForest = Forest();
+		m_forest = &m_ownForest;
+		m_sums = std::vector<Sums>();
+		m_bestColors = std::vector<BestColors<Color>>();
+		m_totalBestColor = std::vector<Color>();
+		m_gifts = std::vector<std::pair<Gift, Price>>();
+		m_prices = std::vector<Price>();
+		m_scratch = Scratch();
+	}
+
+	void setKernel(kernels::Level level) {
+		m_bestTwo = kernels::bestTwo(level);
+	}
+
+	// Computes the two best colorings of all vertices, children have higher numbers than their boss, so going backwards colors them first
+	void colorVertices() {
+		for (Employee v = m_sums.size(); v-- > 0;) {
+			colorVertex(v, m_scratch);
+		}
+	}
+
+	// Chooses the colors of all vertices, after colorVertices
+	void traceVertices() {
+		traceRoots();
+		for (Employee v = 0; v < m_sums.size(); ++v) {
+			traceChildren(v);
+		}
 	}
 
 	void colorGraph() {
-		for (Employee root : m_roots) {
-			colorTree(root);
+		colorVertices();
+		traceVertices();
+	}
+
+#ifndef __PROGTEST__
+	// Colors the trees of the forest on more threads, large trees are split as well.
+	// Bottom-up, every leaf starts a climb towards its root, and the thread which colors the last child of a vertex colors the vertex as well,
+	// so that a vertex is colored only once all its children are. The tasks are ranges of the employees to start the climbs from.
+	// Top-down, the tasks are ranges of already traced vertices whose children are to be traced, a thread traces its range depth first
+	// and hands the oldest part of its work over to its queue whenever the queue runs empty, so that other threads can steal it.
+	void colorGraphParallel(size_t threads = std::thread::hardware_concurrency()) {
+		const Forest &forest = *m_forest;
+		const size_t n = forest.size();
+		threads = std::max<size_t>(threads, 1);
+		const size_t grain = 4096; // employees per bottom-up task, big enough to make the locking of the queues negligible
+		std::vector<Scratch> scratch(threads);
+		for (Scratch &s : scratch) {
+			s.init(m_gifts.size());
+		}
+
+		std::vector<std::atomic<Forest::Index>> uncolored(n); // number of children of a vertex which are not colored yet
+		for (Employee emp = 0; emp < n; ++emp) {
+			uncolored[emp].store(forest.childCount(emp), std::memory_order_relaxed);
+		}
+
+		WorkStealingPool<std::pair<Employee, Employee>> bottomUp(threads);
+		for (Employee from = 0; from < n; from += grain) {
+			// consecutive ranges for each thread, so that a thread works on its own part of the employees until it runs out of them
+			bottomUp.push(from / grain * threads / ((n + grain - 1) / grain), {from, std::min(from + grain, n)});
+		}
+		bottomUp.run([&](std::pair<Employee, Employee> range, size_t worker) {
+			for (Employee emp = range.first; emp < range.second; ++emp) {
+				if (forest.childCount(emp) != 0) {
+					continue;
+				}
+				Forest::Index visiting = emp;
+				while (true) {
+					colorVertex(visiting, scratch[worker]);
+					visiting = forest.parent[visiting];
+					// acquire the colorings of the other children, release this one to the thread which colors the parent
+					if (visiting == Forest::NO_VERTEX || uncolored[visiting].fetch_sub(1, std::memory_order_acq_rel) != 1) {
+						break;
+					}
+				}
+			}
+		});
+
+		// roots are traced right away, in ranges of the grain, and they become the first tasks
+		traceRoots();
+		WorkStealingPool<std::pair<Employee, Employee>> topDown(threads);
+		for (Employee from = 0; from < forest.rootCount; from += grain) {
+			topDown.push(from / grain % threads, {from, std::min(from + grain, forest.rootCount)});
 		}
+		topDown.run([&](std::pair<Employee, Employee> range, size_t worker) {
+			std::vector<std::pair<Employee, Employee>> toVisit = {range};
+			size_t traced = 0;
+			while (!toVisit.empty()) {
+				if (++traced % 1024 == 0 && toVisit.size() > 1 && topDown.idle(worker)) {
+					topDown.push(worker, toVisit.front());
+					toVisit.erase(toVisit.begin());
+				}
+				std::pair<Employee, Employee> &vertices = toVisit.back();
+				Employee visiting = vertices.first++;
+				if (vertices.first == vertices.second) {
+					toVisit.pop_back();
+				}
+				if (forest.childCount(visiting) != 0) {
+					traceChildren(visiting);
+					toVisit.push_back({forest.childrenStart[visiting], forest.childrenStart[visiting + 1]});
+				}
+			}
+		});
 	}
+#endif
 
 	std::pair<Price, std::vector<Gift>> getResult() const {
+		std::vector<Gift> gifts(m_sums.size());
+		Price acc = getResult(gifts.data());
+		return std::make_pair(acc, std::move(gifts));
+	}
+
+	// Writes the gift of each vertex of the forest to gifts and returns the total price
+	Price getVertexResult(Gift *gifts) const {
 		Price acc = 0;
-		for (Employee emp : m_roots) {
-			acc += m_vertices[emp].minSum;
+		for (Employee root = 0; root < m_forest->rootCount; ++root) {
+			acc += m_sums[root].minSum;
+		}
+		for (Employee v = 0; v < m_sums.size(); ++v) {
+			gifts[v] = m_gifts[m_totalBestColor[v]].first;
 		}
+		return acc;
+	}
 
-		std::vector<Gift> gifts;
-		for (Vertex v : m_vertices) {
-			gifts.push_back(m_gifts[v.totalBestColor].first);
+	// Writes the gift of each employee to gifts, which can be of a narrower type if the gifts fit in it, e.g. a mapped file, and returns the total price
+	template <typename Index>
+	Price getResult(Index *gifts) const {
+		const Forest &forest = *m_forest;
+		Price acc = 0;
+		for (Employee root = 0; root < forest.rootCount; ++root) {
+			acc += m_sums[root].minSum;
 		}
-		std::pair<Price, std::vector<Gift>> toRet = std::make_pair(acc, gifts);
-		return toRet;
+
+		// back to the original numbers of the employees
+		for (Employee v = 0; v < m_sums.size(); ++v) {
+			gifts[forest.original[v]] = (Index)m_gifts[m_totalBestColor[v]].first;
+		}
+		return acc;
+	}
+};
+
+// Graphs for any number of gifts, optimize_gifts chooses narrower colors when there are fewer gifts
+using Graph = BasicGraph<uint32_t>;
+inline constexpr size_t NARROW_COLORS = 1 << 16; // most gifts with 16-bit colors
+
+// Graphs owned by the caller of optimize_gifts_reusing, they keep their memory between the calls, so that only the result is allocated once the inputs stop growing.
+// The memory of the largest input is kept until release is called or the graphs are destroyed.
+struct GiftGraphs {
+	BasicGraph<uint16_t> narrow;
+	Graph wide;
+
+	void release() {
+		narrow.release();
+		wide.release();
 	}
 };
 
+template <typename Color>
+std::pair<Price, std::vector<Gift>> optimizeGifts(const std::vector<Employee> &boss, const std::vector<Price> &gift_price, BasicGraph<Color> &g) {
+	g.init(boss, gift_price);
+	g.colorGraph();
+	return g.getResult();
+}
+
+std::pair<Price, std::vector<Gift>> optimize_gifts_reusing(const std::vector<Employee> &boss, const std::vector<Price> &gift_price, GiftGraphs &graphs) {
+	return gift_price.size() <= NARROW_COLORS ? optimizeGifts(boss, gift_price, graphs.narrow) : optimizeGifts(boss, gift_price, graphs.wide);
+}
+
+// The graphs are freed with the result, a caller solving many inputs can keep them with optimize_gifts_reusing
 std::pair<Price, std::vector<Gift>> optimize_gifts(const std::vector<Employee> &boss, const std::vector<Price> &gift_price) {
+	GiftGraphs graphs;
+	return optimize_gifts_reusing(boss, gift_price, graphs);
+}
+
+#ifndef __PROGTEST__
+std::pair<Price, std::vector<Gift>> optimize_gifts_parallel(const std::vector<Employee> &boss, const std::vector<Price> &gift_price, size_t threads = std::thread::hardware_concurrency()) {
+	if (gift_price.size() <= NARROW_COLORS) {
+		BasicGraph<uint16_t> g(boss, gift_price);
+		g.colorGraphParallel(threads);
+		return g.getResult();
+	}
 	Graph g(boss, gift_price);
-	g.colorGraph();
+	g.colorGraphParallel(threads);
 	return g.getResult();
 }
+#endif
 
 #ifndef __PROGTEST__
+template <typename Color>
+void optimizeGiftsBatch(const Forest &forest, const std::vector<std::vector<Price>> &gift_prices, std::vector<std::pair<Price, std::vector<Gift>>> &results, size_t threads) {
+	std::vector<BasicGraph<Color>> graphs(threads);
+	WorkStealingPool<size_t> pool(threads);
+	for (size_t i = 0; i < gift_prices.size(); ++i) {
+		pool.push(i % threads, i);
+	}
+	pool.run([&](size_t i, size_t worker) {
+		graphs[worker].init(forest, gift_prices[i]);
+		graphs[worker].colorGraph();
+		results[i] = graphs[worker].getResult();
+	});
+}
+
+// Solves more price lists of the gifts for the same bosses. The forest is built only once and shared by the threads,
+// each thread colors it with one price list at a time, reusing its graph for the next one.
+std::vector<std::pair<Price, std::vector<Gift>>> optimize_gifts_batch(const std::vector<Employee> &boss, const std::vector<std::vector<Price>> &gift_prices, size_t threads = std::thread::hardware_concurrency()) {
+	Forest forest;
+	forest.init(boss);
+	threads = std::max<size_t>(std::min(threads, gift_prices.size()), 1);
+	std::vector<std::pair<Price, std::vector<Gift>>> results(gift_prices.size());
+	size_t gifts = 0;
+	for (const std::vector<Price> &gift_price : gift_prices) {
+		gifts = std::max(gifts, gift_price.size());
+	}
+	if (gifts <= NARROW_COLORS) {
+		optimizeGiftsBatch<uint16_t>(forest, gift_prices, results, threads);
+	} else {
+		optimizeGiftsBatch<uint32_t>(forest, gift_prices, results, threads);
+	}
+	return results;
+}
+#endif
+
+struct CapacitatedResult {
+	Price price; // of the gifts, without the multipliers
+	std::vector<Gift> gifts;
+	bool feasible;	  // false if no assignment keeping the capacities was found
+	Price lowerBound; // no assignment keeping the capacities is cheaper
+};
+
+// Moves employees away from the gifts over their capacity, each one to the cheapest gift with free capacity which neither its boss nor its children have.
+// The employees which get the least expensive moves go first. Returns whether all capacities are kept. gifts and count are by vertices.
+inline bool repairCapacities(const Forest &forest, const std::vector<Price> &gift_price, const std::vector<size_t> &capacity, std::vector<Gift> &gifts, std::vector<size_t> &count) {
+	std::set<std::pair<Price, Gift>> free; // gifts with free capacity, by their price
+	for (Gift g = 0; g < gift_price.size(); ++g) {
+		if (count[g] < capacity[g]) {
+			free.insert({gift_price[g], g});
+		}
+	}
+	std::vector<Employee> forbidden(gift_price.size(), NO_EMPLOYEE); // the vertex for which the gift is taken by a neighbour
+	auto cheapestMove = [&](Employee v) -> std::optional<Gift> {
+		if (forest.parent[v] != Forest::NO_VERTEX) {
+			forbidden[gifts[forest.parent[v]]] = v;
+		}
+		for (Employee i = forest.childrenStart[v]; i < forest.childrenStart[v + 1]; ++i) {
+			forbidden[gifts[i]] = v;
+		}
+		for (const std::pair<Price, Gift> &gift : free) { // at most (number of children + 1) gifts are skipped
+			if (forbidden[gift.second] != v) {
+				return gift.second;
+			}
+		}
+		return std::nullopt;
+	};
+
+	std::vector<std::pair<Price, Employee>> moves; // extra price of the cheapest move of each vertex with a gift over its capacity
+	for (Employee v = 0; v < forest.size(); ++v) {
+		if (count[gifts[v]] > capacity[gifts[v]]) {
+			if (std::optional<Gift> to = cheapestMove(v)) {
+				moves.push_back({gift_price[*to] - std::min(gift_price[*to], gift_price[gifts[v]]), v});
+			}
+		}
+	}
+	std::sort(moves.begin(), moves.end());
+	for (const std::pair<Price, Employee> &move : moves) {
+		Employee v = move.second;
+		if (count[gifts[v]] <= capacity[gifts[v]]) {
+			continue;
+		}
+		// the neighbours and the free gifts may have changed since
+		std::optional<Gift> to = cheapestMove(v);
+		if (!to) {
+			continue;
+		}
+		--count[gifts[v]];
+		gifts[v] = *to;
+		if (++count[*to] == capacity[*to]) {
+			free.erase({gift_price[*to], *to});
+		}
+	}
+	for (Gift g = 0; g < gift_price.size(); ++g) {
+		if (count[g] > capacity[g]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Lagrangian relaxation of the capacities: each gift costs its price plus a multiplier, and the unconstrained coloring is solved with these prices.
+// The relaxed price minus the multipliers times the capacities is a lower bound of the price keeping the capacities. The multipliers move
+// by the subgradient, the employees over or under the capacity of each gift, with the step of Polyak: the gap between the best price keeping
+// the capacities and the lower bound, shrunk by a factor which halves whenever the bound stops improving.
+// Each iteration is one coloring of the same forest, so it stays linear. The colorings with fewer employees over the capacities than all before
+// are repaired, which is near-linear. The cheapest coloring which keeps the capacities, right away or after the repair, is the result.
+template <typename Color>
+CapacitatedResult optimizeGiftsCapacitated(const Forest &forest, const std::vector<Price> &gift_price, const std::vector<size_t> &capacity, size_t iterations) {
+	const size_t n = forest.size(), k = gift_price.size();
+	size_t totalCapacity = 0;
+	for (size_t c : capacity) {
+		totalCapacity += std::min(c, n);
+	}
+
+	CapacitatedResult result = {0, {}, false, 0};
+	// the cheapest gifts up to their capacities, as if no boss and employee could get the same gift, is a lower bound as well
+	std::vector<std::pair<Price, size_t>> byPrice(k);
+	for (Gift gift = 0; gift < k; ++gift) {
+		byPrice[gift] = {gift_price[gift], capacity[gift]};
+	}
+	std::sort(byPrice.begin(), byPrice.end());
+	size_t remaining = n;
+	for (const std::pair<Price, size_t> &gift : byPrice) {
+		size_t given = std::min(remaining, gift.second);
+		result.lowerBound += gift.first * given;
+		remaining -= given;
+	}
+
+	std::vector<double> multiplier(k, 0);
+	std::vector<Price> adjusted(k), rounded(k);
+	std::vector<Gift> gifts(n), repaired(n), best; // by the vertices of the forest
+	std::vector<size_t> count(k), repairedCount(k); // the multipliers follow the counts before the repair
+	size_t leastOver = std::numeric_limits<size_t>::max();
+	Price dual = 0; // the best lower bound of the relaxation, the steps aim at it
+	double factor = 2;
+	size_t stalled = 0; // iterations since the lower bound last improved
+	BasicGraph<Color> g;
+	for (size_t iteration = 0; iteration < iterations; ++iteration) {
+		for (Gift gift = 0; gift < k; ++gift) {
+			rounded[gift] = std::llround(multiplier[gift]);
+			adjusted[gift] = gift_price[gift] + rounded[gift];
+		}
+		g.init(forest, adjusted);
+		g.colorGraph();
+		Price relaxed = g.getVertexResult(gifts.data());
+
+		std::fill(count.begin(), count.end(), 0);
+		Price price = 0;
+		for (Gift gift : gifts) {
+			++count[gift];
+			price += gift_price[gift];
+		}
+		Price reserved = 0;
+		size_t over = 0;
+		for (Gift gift = 0; gift < k; ++gift) {
+			reserved += rounded[gift] * std::min(capacity[gift], n);
+			over += count[gift] - std::min(count[gift], capacity[gift]);
+		}
+		if (relaxed > reserved && relaxed - reserved > dual) {
+			dual = relaxed - reserved;
+			result.lowerBound = std::max(result.lowerBound, dual);
+			stalled = 0;
+		} else if (++stalled == 3) {
+			factor /= 2;
+			stalled = 0;
+		}
+		if (over == 0 && (!result.feasible || price < result.price)) {
+			result.feasible = true;
+			result.price = price;
+			best = gifts;
+		} else if (over != 0 && (over <= leastOver || !result.feasible) && totalCapacity >= n) {
+			leastOver = std::min(leastOver, over);
+			repaired = gifts;
+			repairedCount = count;
+			if (repairCapacities(forest, gift_price, capacity, repaired, repairedCount)) {
+				Price repairedPrice = 0;
+				for (Gift gift : repaired) {
+					repairedPrice += gift_price[gift];
+				}
+				if (!result.feasible || repairedPrice < result.price) {
+					result.feasible = true;
+					result.price = repairedPrice;
+					best.swap(repaired);
+				}
+			}
+		}
+		if (result.feasible && result.price == result.lowerBound) {
+			break; // optimal
+		}
+
+		double norm = 0;
+		for (Gift gift = 0; gift < k; ++gift) {
+			double violation = (double)count[gift] - (double)std::min(capacity[gift], n);
+			if (violation > 0 || multiplier[gift] > 0) {
+				norm += violation * violation;
+			}
+		}
+		if (norm == 0) {
+			break; // the multipliers would not change
+		}
+		// without a price keeping the capacities yet, the gap is guessed from the price of the relaxed coloring
+		double gap = (double)(result.feasible ? result.price : price + (price >> 1)) - (double)dual;
+		double step = factor * std::max(gap, 1.0) / norm;
+		for (Gift gift = 0; gift < k; ++gift) {
+			multiplier[gift] = std::max(0.0, multiplier[gift] + step * ((double)count[gift] - (double)std::min(capacity[gift], n)));
+		}
+	}
+
+	if (result.feasible) {
+		result.gifts.resize(n);
+		for (Employee v = 0; v < n; ++v) {
+			result.gifts[forest.original[v]] = best[v];
+		}
+	}
+	return result;
+}
+
+// Gifts with at most capacity[g] employees getting gift g. The result may not be optimal, but it is never cheaper than the lower bound,
+// and it is not feasible if no assignment keeping the capacities was found.
+CapacitatedResult optimize_gifts_capacitated(const std::vector<Employee> &boss, const std::vector<Price> &gift_price, const std::vector<size_t> &capacity, size_t iterations = 10) {
+	if (capacity.size() != gift_price.size()) {
+		throw std::invalid_argument("every gift needs a capacity");
+	}
+	Forest forest;
+	forest.init(boss);
+	return gift_price.size() <= NARROW_COLORS ? optimizeGiftsCapacitated<uint16_t>(forest, gift_price, capacity, iterations)
+											  : optimizeGiftsCapacitated<uint32_t>(forest, gift_price, capacity, iterations);
+}
+
+// Keeps the minimal sum coloring of the forest up to date while the employees change their bosses and the gifts their prices.
+// Instead of lists of children, each vertex keeps what colorVertex computes from them: the sum of the minimal sums of its children,
+// and the corrections of the colors which are the first best colors of some children, each with a list of these children.
+// A change of a vertex then changes its boss in O(number of corrections) and the change climbs up only as long as the colorings change.
+// The total best colors are traced down from the changed vertices, and only children whose first best color is the old or the new color of their boss can change.
+// Colors are the gift numbers themselves, so that a change of price does not renumber them.
+// Employees who depart keep their numbers, but get no gift and are not counted in the price.
+class GiftOptimizer {
+public:
+	static constexpr Gift NO_GIFT = std::numeric_limits<Gift>::max(); // the gift of a departed employee
+
+private:
+	struct Correction {
+		Gift color;
+		Price sum;	   // sum of (minSum2 - minSum) of the children whose first best color is this color
+		Employee head; // first of these children, linked by their siblings
+	};
+
+	struct Node {
+		Employee parent;
+		Gift totalBestColor;
+		Gift firstBestColor;
+		Price minSum;
+		Gift secondBestColor;
+		Price minSum2;
+
+		Price base; // sum of minSum of all children
+		std::vector<Correction> corrections;
+		// neighbours in the list of children of the boss with the same first best color, or in the list of roots
+		Employee prevSibling;
+		Employee nextSibling;
+		// neighbours in the list of all vertices with the same first best color
+		Employee prevSame;
+		Employee nextSame;
+		// neighbours in the list of all vertices with the same number of corrections, vertices without corrections are in no list
+		Employee prevCorrected;
+		Employee nextCorrected;
+		bool departed;
+
+		Node(Employee boss) : parent(boss) {
+			totalBestColor = firstBestColor = secondBestColor = 0;
+			minSum = minSum2 = base = 0;
+			prevSibling = nextSibling = prevSame = nextSame = prevCorrected = nextCorrected = NO_EMPLOYEE;
+			departed = false;
+		}
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<Price> m_prices;
+	std::set<std::pair<Price, Gift>> m_byPrice; // gifts sorted by their price
+	std::vector<Employee> m_firstHead;			// first of the vertices whose first best color is the gift
+	std::vector<Employee> m_correctedHead;		// first of the vertices with the number of corrections, its size is above the number of corrections of any vertex
+	Employee m_rootHead;
+	Price m_price;
+	// the corrections of one vertex at a time are indexed by their colors, an entry is valid if it is stamped with that vertex
+	std::vector<Employee> m_correctionOwner;
+	std::vector<size_t> m_correctionIndex; // position of the correction in the corrections of the vertex
+	Employee m_indexed = NO_EMPLOYEE;
+	// colors of the corrections of the vertex being colored, stamped with the number of the coloring, so that they never have to be cleared
+	std::vector<size_t> m_correctedIn;
+	size_t m_colorings = 0;
+
+	bool exists(Employee emp) const {
+		return emp < m_nodes.size() && !m_nodes[emp].departed;
+	}
+
+	// The corrections of a vertex change only while it is indexed, so it is indexed again only when another vertex was indexed in between.
+	// That costs the number of its corrections, and the children of a boss are attached and detached one after another.
+	Correction *findCorrection(Employee emp, Gift color) {
+		std::vector<Correction> &corrections = m_nodes[emp].corrections;
+		if (m_indexed != emp) {
+			for (size_t i = 0; i < corrections.size(); ++i) {
+				m_correctionOwner[corrections[i].color] = emp;
+				m_correctionIndex[corrections[i].color] = i;
+			}
+			m_indexed = emp;
+		}
+		return m_correctionOwner[color] == emp ? &corrections[m_correctionIndex[color]] : nullptr;
+	}
+
+	// Adds the vertex to the list of its number of corrections, before which it must not be in any list
+	void listCorrected(Employee emp) {
+		Node &node = m_nodes[emp];
+		size_t count = node.corrections.size();
+		if (count == 0) {
+			return;
+		}
+		if (count >= m_correctedHead.size()) {
+			m_correctedHead.resize(count + 1, NO_EMPLOYEE);
+		}
+		node.prevCorrected = NO_EMPLOYEE;
+		node.nextCorrected = m_correctedHead[count];
+		if (node.nextCorrected != NO_EMPLOYEE) {
+			m_nodes[node.nextCorrected].prevCorrected = emp;
+		}
+		m_correctedHead[count] = emp;
+	}
+
+	// Removes the vertex from the list of its number of corrections, before they change
+	void unlistCorrected(Employee emp) {
+		Node &node = m_nodes[emp];
+		if (node.corrections.empty()) {
+			return;
+		}
+		if (node.prevCorrected != NO_EMPLOYEE) {
+			m_nodes[node.prevCorrected].nextCorrected = node.nextCorrected;
+		} else {
+			m_correctedHead[node.corrections.size()] = node.nextCorrected;
+		}
+		if (node.nextCorrected != NO_EMPLOYEE) {
+			m_nodes[node.nextCorrected].prevCorrected = node.prevCorrected;
+		}
+	}
+
+	// Adds the coloring of the vertex to its boss, or to the total price if it has no boss
+	void attach(Employee emp) {
+		Node &node = m_nodes[emp];
+		node.prevSame = NO_EMPLOYEE;
+		node.nextSame = m_firstHead[node.firstBestColor];
+		if (node.nextSame != NO_EMPLOYEE) {
+			m_nodes[node.nextSame].prevSame = emp;
+		}
+		m_firstHead[node.firstBestColor] = emp;
+		node.prevSibling = NO_EMPLOYEE;
+		if (node.parent == NO_EMPLOYEE) {
+			m_price += node.minSum;
+			node.nextSibling = m_rootHead;
+			m_rootHead = emp;
+		} else {
+			Node &boss = m_nodes[node.parent];
+			boss.base += node.minSum;
+			Correction *correction = findCorrection(node.parent, node.firstBestColor);
+			if (!correction) {
+				unlistCorrected(node.parent);
+				m_correctionOwner[node.firstBestColor] = node.parent;
+				m_correctionIndex[node.firstBestColor] = boss.corrections.size();
+				boss.corrections.push_back({node.firstBestColor, 0, NO_EMPLOYEE});
+				listCorrected(node.parent);
+				correction = &boss.corrections.back();
+			}
+			correction->sum += node.minSum2 - node.minSum;
+			node.nextSibling = correction->head;
+			correction->head = emp;
+		}
+		if (node.nextSibling != NO_EMPLOYEE) {
+			m_nodes[node.nextSibling].prevSibling = emp;
+		}
+	}
+
+	// Removes the coloring of the vertex from its boss, or from the total price if it has no boss
+	void detach(Employee emp) {
+		Node &node = m_nodes[emp];
+		if (node.prevSame != NO_EMPLOYEE) {
+			m_nodes[node.prevSame].nextSame = node.nextSame;
+		} else {
+			m_firstHead[node.firstBestColor] = node.nextSame;
+		}
+		if (node.nextSame != NO_EMPLOYEE) {
+			m_nodes[node.nextSame].prevSame = node.prevSame;
+		}
+		Employee *head = &m_rootHead;
+		if (node.parent == NO_EMPLOYEE) {
+			m_price -= node.minSum;
+		} else {
+			Node &boss = m_nodes[node.parent];
+			boss.base -= node.minSum;
+			Correction *correction = findCorrection(node.parent, node.firstBestColor);
+			correction->sum -= node.minSum2 - node.minSum;
+			head = &correction->head;
+		}
+		if (node.prevSibling != NO_EMPLOYEE) {
+			m_nodes[node.prevSibling].nextSibling = node.nextSibling;
+		} else {
+			*head = node.nextSibling;
+		}
+		if (node.nextSibling != NO_EMPLOYEE) {
+			m_nodes[node.nextSibling].prevSibling = node.prevSibling;
+		}
+		if (*head == NO_EMPLOYEE && node.parent != NO_EMPLOYEE) { // no child has this first best color anymore
+			std::vector<Correction> &corrections = m_nodes[node.parent].corrections;
+			size_t index = m_correctionIndex[node.firstBestColor];
+			unlistCorrected(node.parent);
+			std::swap(corrections[index], corrections.back());
+			corrections.pop_back();
+			if (index < corrections.size()) {
+				m_correctionIndex[corrections[index].color] = index;
+			}
+			m_correctionOwner[node.firstBestColor] = NO_EMPLOYEE;
+			listCorrected(node.parent);
+		}
+	}
+
+	// Same as Graph::colorVertex, but with the sums of the children kept in the vertex
+	void colorVertex(Employee emp) {
+		Node &node = m_nodes[emp];
+		Gift pos1 = m_prices.size(); // no color considered yet
+		Gift pos2 = m_prices.size();
+		Price min1 = std::numeric_limits<Price>::max();
+		Price min2 = std::numeric_limits<Price>::max();
+		auto consider = [&](Gift k, Price p) {
+			if (p < min1 || (p == min1 && k < pos1)) {
+				min2 = min1;
+				pos2 = pos1;
+				min1 = p;
+				pos1 = k;
+			} else if (p < min2 || (p == min2 && k < pos2)) {
+				min2 = p;
+				pos2 = k;
+			}
+		};
+		++m_colorings;
+		for (const Correction &correction : node.corrections) {
+			m_correctedIn[correction.color] = m_colorings;
+			consider(correction.color, m_prices[correction.color] + node.base + correction.sum);
+		}
+		size_t found = 0;
+		for (auto it = m_byPrice.begin(); it != m_byPrice.end() && found < 2; ++it) {
+			if (m_correctedIn[it->second] != m_colorings) {
+				consider(it->second, it->first + node.base);
+				++found;
+			}
+		}
+		node.firstBestColor = pos1;
+		node.minSum = min1;
+		node.secondBestColor = pos2;
+		node.minSum2 = min2;
+	}
+
+	// Recolors the vertex and its bosses as long as their colorings change, the recolored vertices are added to changed
+	void climb(Employee emp, std::vector<Employee> &changed) {
+		while (emp != NO_EMPLOYEE) {
+			Node &node = m_nodes[emp];
+			Gift first = node.firstBestColor, second = node.secondBestColor;
+			Price minSum = node.minSum, minSum2 = node.minSum2;
+			detach(emp);
+			colorVertex(emp);
+			attach(emp);
+			if (first == node.firstBestColor && second == node.secondBestColor && minSum == node.minSum && minSum2 == node.minSum2) {
+				return;
+			}
+			changed.push_back(emp);
+			emp = node.parent;
+		}
+	}
+
+	// Chooses the total best colors of the changed vertices and goes down only to the children whose color can change
+	void trace(const std::vector<Employee> &changed) {
+		std::vector<Employee> toVisit = changed; // visited from the back, so the highest vertices of a path are traced first
+		while (!toVisit.empty()) {
+			Employee visiting = toVisit.back();
+			toVisit.pop_back();
+			Node &node = m_nodes[visiting];
+			Gift old = node.totalBestColor;
+			node.totalBestColor = (node.parent == NO_EMPLOYEE || node.firstBestColor != m_nodes[node.parent].totalBestColor) ? node.firstBestColor : node.secondBestColor;
+			if (node.totalBestColor == old) {
+				continue;
+			}
+			// children with the first best color equal to the old color may now use it, children with the new one may not
+			for (Gift color : {old, node.totalBestColor}) {
+				Correction *correction = findCorrection(visiting, color);
+				for (Employee child = correction ? correction->head : NO_EMPLOYEE; child != NO_EMPLOYEE; child = m_nodes[child].nextSibling) {
+					toVisit.push_back(child);
+				}
+			}
+		}
+	}
+
+	// Colors everything from scratch
+	void rebuild() {
+		size_t n = m_nodes.size();
+		std::vector<Employee> childrenStart(n + 1, 0), children(n);
+		for (Node &node : m_nodes) {
+			node.base = 0;
+			node.corrections.clear();
+			if (node.parent != NO_EMPLOYEE) {
+				++childrenStart[node.parent + 1];
+			}
+		}
+		for (Employee emp = 0; emp < n; ++emp) {
+			childrenStart[emp + 1] += childrenStart[emp];
+		}
+		std::vector<Employee> fill(childrenStart.begin(), childrenStart.end() - 1);
+		std::vector<Employee> preorder;
+		preorder.reserve(n);
+		for (Employee emp = 0; emp < n; ++emp) {
+			if (m_nodes[emp].departed) {
+				continue;
+			}
+			if (m_nodes[emp].parent == NO_EMPLOYEE) {
+				preorder.push_back(emp);
+			} else {
+				children[fill[m_nodes[emp].parent]++] = emp;
+			}
+		}
+		for (size_t i = 0; i < preorder.size(); ++i) { // breadth first, bosses before their employees
+			for (Employee j = childrenStart[preorder[i]]; j < childrenStart[preorder[i] + 1]; ++j) {
+				preorder.push_back(children[j]);
+			}
+		}
+
+		m_firstHead.assign(m_prices.size(), NO_EMPLOYEE);
+		m_correctedHead.clear();
+		m_correctionOwner.assign(m_prices.size(), NO_EMPLOYEE);
+		m_correctionIndex.resize(m_prices.size());
+		m_indexed = NO_EMPLOYEE;
+		m_rootHead = NO_EMPLOYEE;
+		m_price = 0;
+		for (size_t i = preorder.size(); i-- > 0;) {
+			colorVertex(preorder[i]);
+			attach(preorder[i]);
+		}
+		for (Employee emp : preorder) {
+			Node &node = m_nodes[emp];
+			node.totalBestColor = (node.parent == NO_EMPLOYEE || node.firstBestColor != m_nodes[node.parent].totalBestColor) ? node.firstBestColor : node.secondBestColor;
+		}
+	}
+
+	// Position of the gift among the gifts sorted by price, or the limit if it is not before it
+	size_t rank(Gift gift, size_t limit) const {
+		size_t position = 0;
+		for (auto it = m_byPrice.begin(); position < limit && it->second != gift; ++it) {
+			++position;
+		}
+		return position;
+	}
+
+
+public:
+	GiftOptimizer(const std::vector<Employee> &boss, const std::vector<Price> &gift_price) : m_prices(gift_price) {
+		m_nodes.reserve(boss.size());
+		for (Employee emp : boss) {
+			m_nodes.emplace_back(emp);
+		}
+		for (Gift gift = 0; gift < m_prices.size(); ++gift) {
+			m_byPrice.insert({m_prices[gift], gift});
+		}
+		m_correctedIn.assign(m_prices.size(), 0);
+		rebuild();
+	}
+
+	Price price() const {
+		return m_price;
+	}
+
+	std::vector<Gift> gifts() const {
+		std::vector<Gift> gifts;
+		gifts.reserve(m_nodes.size());
+		for (const Node &node : m_nodes) {
+			gifts.push_back(node.departed ? NO_GIFT : node.totalBestColor);
+		}
+		return gifts;
+	}
+
+	Gift gift(Employee emp) const {
+		const Node &node = m_nodes.at(emp);
+		return node.departed ? NO_GIFT : node.totalBestColor;
+	}
+
+	// Gives the employee a new boss (or no boss), the employee must not become its own boss
+	void reassign(Employee emp, Employee boss) {
+		if (!exists(emp) || (boss != NO_EMPLOYEE && !exists(boss)))
+			throw std::out_of_range("Employee does not exist");
+		for (Employee visiting = boss; visiting != NO_EMPLOYEE; visiting = m_nodes[visiting].parent) {
+			if (visiting == emp)
+				throw std::invalid_argument("Employee would be their own boss");
+		}
+		Employee oldBoss = m_nodes[emp].parent;
+		detach(emp);
+		m_nodes[emp].parent = boss;
+		attach(emp);
+		// both the old and the new boss lose or gain a child, the employee itself may have to change its gift
+		std::vector<Employee> changed = {emp};
+		climb(oldBoss, changed);
+		climb(boss, changed);
+		trace(changed);
+	}
+
+	// Adds a new employee with the given boss (or no boss), returns its number
+	Employee hire(Employee boss) {
+		if (boss != NO_EMPLOYEE && !exists(boss))
+			throw std::out_of_range("Employee does not exist");
+		Employee emp = m_nodes.size();
+		m_nodes.emplace_back(boss);
+		colorVertex(emp);
+		attach(emp);
+		std::vector<Employee> changed = {emp};
+		climb(boss, changed);
+		trace(changed);
+		return emp;
+	}
+
+	// Removes the employee, their employees get the employee's boss (or no boss)
+	void depart(Employee emp) {
+		if (!exists(emp))
+			throw std::out_of_range("Employee does not exist");
+		Node &node = m_nodes[emp];
+		std::vector<Employee> changed;
+		for (const Correction &correction : node.corrections) {
+			for (Employee child = correction.head; child != NO_EMPLOYEE; child = m_nodes[child].nextSibling) {
+				changed.push_back(child);
+			}
+		}
+		// the colorings of the employees do not change, only their total best colors can, once their new boss is traced.
+		// All are detached before any is attached, so that the corrections of the employee and of the boss are indexed once each.
+		for (Employee child : changed) {
+			detach(child);
+		}
+		for (Employee child : changed) {
+			m_nodes[child].parent = node.parent;
+			attach(child);
+		}
+		// the employee has no corrections left, its coloring is removed from its boss
+		detach(emp);
+		node.departed = true;
+		climb(node.parent, changed);
+		node.parent = NO_EMPLOYEE;
+		trace(changed);
+	}
+
+	void setPrice(Gift gift, Price price) {
+		if (gift >= m_prices.size())
+			throw std::out_of_range("Gift does not exist");
+		// no vertex has more corrections than the limit, so a rank above it recolors the same vertices and is not counted further
+		size_t limit = std::max<size_t>(2, m_correctedHead.size() + 1);
+		size_t oldRank = rank(gift, limit);
+		m_byPrice.erase({m_prices[gift], gift});
+		m_prices[gift] = price;
+		m_byPrice.insert({m_prices[gift], gift});
+		// A vertex considers only the colors of its corrections and the two cheapest other colors. If the gift is one of the two cheapest colors,
+		// it is one of the colors of every vertex, and everything is colored again.
+		size_t minRank = std::min(oldRank, rank(gift, limit));
+		if (minRank < 2) {
+			rebuild();
+			return;
+		}
+		// Otherwise the gift is a color of the vertices with its correction, which are the bosses of the vertices whose first best color it is,
+		// and of the vertices which have the corrections of all but one of the colors cheaper than it, so at least (minRank - 1) corrections.
+		// Only these vertices are recolored.
+		std::vector<Employee> recolored;
+		for (Employee emp = m_firstHead[gift]; emp != NO_EMPLOYEE; emp = m_nodes[emp].nextSame) {
+			if (m_nodes[emp].parent != NO_EMPLOYEE) {
+				recolored.push_back(m_nodes[emp].parent);
+			}
+		}
+		for (size_t count = minRank - 1; count < m_correctedHead.size(); ++count) {
+			for (Employee emp = m_correctedHead[count]; emp != NO_EMPLOYEE; emp = m_nodes[emp].nextCorrected) {
+				recolored.push_back(emp);
+			}
+		}
+		std::sort(recolored.begin(), recolored.end());
+		recolored.erase(std::unique(recolored.begin(), recolored.end()), recolored.end());
+		std::vector<Employee> changed;
+		for (Employee emp : recolored) {
+			climb(emp, changed);
+		}
+		trace(changed);
+	}
+};
+
+#ifndef __PROGTEST__
+
+// Counts the allocations of the whole program, so that the tests can check that the solver reuses its memory
+std::atomic<size_t> g_allocations = 0;
+
+void *operator new(size_t size) {
+	++g_allocations;
+	if (void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+// not inlined, so that the compiler does not mistake the matching malloc and free for mismatched new and free
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// Binary org charts of the biggest companies: the header, the bosses as 32-bit numbers with UINT32_MAX for the supreme bosses,
+// padded to a multiple of 8 bytes, and the 64-bit prices of the gifts. The solver reads the bosses right from the mapped file
+// and writes the gifts to another mapped file, as 16-bit numbers, or as 32-bit ones if there are more than 65536 gifts.
+struct ChartHeader {
+	char magic[4]; // "HW3C"
+	uint32_t employees;
+	uint64_t gifts;
+};
+
+// A file mapped to memory until the object is destroyed
+class MappedFile {
+private:
+	void *m_data = MAP_FAILED;
+	size_t m_size = 0;
+
+public:
+	// Maps an existing file for reading, or creates a file of the given size for writing
+	MappedFile(const char *path, size_t createSize = 0) {
+		int fd = createSize ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error(std::string("cannot open ") + path);
+		}
+		struct stat info;
+		if ((createSize && ftruncate(fd, createSize) != 0) || fstat(fd, &info) != 0) {
+			close(fd);
+			throw std::runtime_error(std::string("cannot resize ") + path);
+		}
+		m_size = info.st_size;
+		if (m_size) {
+			m_data = mmap(nullptr, m_size, createSize ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		}
+		close(fd); // the mapping keeps the file open
+		if (m_size && m_data == MAP_FAILED) {
+			throw std::runtime_error(std::string("cannot map ") + path);
+		}
+		if (m_size && !createSize) {
+			madvise(m_data, m_size, MADV_SEQUENTIAL);
+		}
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	~MappedFile() {
+		if (m_data != MAP_FAILED) {
+			munmap(m_data, m_size);
+		}
+	}
+
+	void *data() const {
+		return m_data;
+	}
+
+	size_t size() const {
+		return m_size;
+	}
+};
+
+void save_chart(const char *path, const std::vector<Employee> &boss, const std::vector<Price> &gift_price) {
+	if (boss.size() >= std::numeric_limits<uint32_t>::max()) {
+		throw std::invalid_argument("too many employees for a binary org chart");
+	}
+	ChartHeader header = {{'H', 'W', '3', 'C'}, (uint32_t)boss.size(), gift_price.size()};
+	std::vector<uint32_t> bosses(boss.size() + boss.size() % 2, 0);
+	for (Employee emp = 0; emp < boss.size(); ++emp) {
+		bosses[emp] = boss[emp] == NO_EMPLOYEE ? std::numeric_limits<uint32_t>::max() : (uint32_t)boss[emp];
+	}
+	std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(path, "wb"), fclose);
+	auto write = [&file](const void *data, size_t size, size_t count) { return count == 0 || fwrite(data, size, count, file.get()) == count; };
+	if (!file || !write(&header, sizeof(header), 1) || !write(bosses.data(), sizeof(uint32_t), bosses.size()) || !write(gift_price.data(), sizeof(Price), gift_price.size())) {
+		throw std::runtime_error(std::string("cannot write ") + path);
+	}
+}
+
+// the gifts are written in the width of the colors
+template <typename Color>
+Price solveChart(const Forest &forest, const std::vector<Price> &gift_price, const char *output) {
+	BasicGraph<Color> g;
+	g.init(forest, gift_price);
+	g.colorGraph();
+	MappedFile result(output, std::max<size_t>(forest.size() * sizeof(Color), 1));
+	return g.getResult((Color *)result.data());
+}
+
+// Solves the org chart in the input file, writes the gifts to the output file and returns the total price
+Price solve_chart(const char *input, const char *output) {
+	MappedFile chart(input);
+	const ChartHeader *header = (const ChartHeader *)chart.data();
+	if (chart.size() < sizeof(ChartHeader) || memcmp(header->magic, "HW3C", 4) != 0) {
+		throw std::invalid_argument(std::string(input) + " is not a binary org chart");
+	}
+	// in size_t and without multiplying the number of gifts, so that no count from the file can wrap the size around
+	size_t bosses = (size_t)header->employees + header->employees % 2;
+	size_t rest = chart.size() - sizeof(ChartHeader);
+	if (rest < bosses * sizeof(uint32_t) || (rest - bosses * sizeof(uint32_t)) % sizeof(Price) != 0 || (rest - bosses * sizeof(uint32_t)) / sizeof(Price) != header->gifts) {
+		throw std::invalid_argument(std::string(input) + " is not a binary org chart");
+	}
+	const uint32_t *boss = (const uint32_t *)(header + 1);
+	const Price *prices = (const Price *)(boss + bosses);
+
+	Forest forest;
+	forest.init(boss, header->employees); // checks the bosses
+	std::vector<Price> gift_price(prices, prices + header->gifts);
+	return header->gifts <= NARROW_COLORS ? solveChart<uint16_t>(forest, gift_price, output) : solveChart<uint32_t>(forest, gift_price, output);
+}
 
 const std::tuple<Price, std::vector<Employee>, std::vector<Price>> EXAMPLES[] = {
 	{17, {1, 2, 3, 4, NO_EMPLOYEE}, {25, 4, 18, 3}},
@@ -217,8 +1508,10 @@ const std::tuple<Price, std::vector<Employee>, std::vector<Price>> EXAMPLES[] =
 		return false;                        \
 	} while (0)
 
-bool test(Price p, const std::vector<Employee> &boss, const std::vector<Price> &gp) {
-	auto &&[sol_p, sol_g] = optimize_gifts(boss, gp);
+using Solver = std::function<std::pair<Price, std::vector<Gift>>(const std::vector<Employee> &, const std::vector<Price> &)>;
+
+bool test(Price p, const std::vector<Employee> &boss, const std::vector<Price> &gp, const Solver &solve = optimize_gifts) {
+	auto &&[sol_p, sol_g] = solve(boss, gp);
 	CHECK(sol_g.size() == boss.size(),
 		  "Size of the solution: expected %zu but got %zu.", boss.size(), sol_g.size());
 
@@ -243,15 +1536,678 @@ bool test(Price p, const std::vector<Employee> &boss, const std::vector<Price> &
 }
 #undef CHECK
 
-int main() {
+// Reference minimal price, which tries every gift for every employee
+Price naive_price(const std::vector<Employee> &boss, const std::vector<Price> &gp) {
+	size_t n = boss.size();
+	std::vector<std::vector<Price>> cost(n, gp); // cost[e][g] - the cheapest sub-tree of e if e gets gift g
+	std::vector<size_t> depth(n, 0);
+	for (Employee e = 0; e < n; ++e)
+		for (Employee b = boss[e]; b != NO_EMPLOYEE; b = boss[b])
+			++depth[e];
+	std::vector<Employee> byDepth(n);
+	for (Employee e = 0; e < n; ++e)
+		byDepth[e] = e;
+	std::sort(byDepth.begin(), byDepth.end(), [&](Employee a, Employee b) { return depth[a] > depth[b]; });
+
+	Price total = 0;
+	for (Employee e : byDepth) {
+		if (boss[e] == NO_EMPLOYEE) {
+			total += *std::min_element(cost[e].begin(), cost[e].end());
+			continue;
+		}
+		for (Gift g = 0; g < gp.size(); ++g) {
+			Price best = std::numeric_limits<Price>::max();
+			for (Gift h = 0; h < gp.size(); ++h)
+				if (h != g)
+					best = std::min(best, cost[e][h]);
+			cost[boss[e]][g] += best;
+		}
+	}
+	return total;
+}
+
+bool test_random(size_t n, size_t k, size_t seed, const Solver &solve = optimize_gifts) {
+	std::mt19937 my_rand(24707 + seed);
+	// bosses are renumbered randomly, so that they are not always before their employees
+	std::vector<Employee> number(n);
+	for (Employee e = 0; e < n; ++e)
+		number[e] = e;
+	std::shuffle(number.begin(), number.end(), my_rand);
+	std::vector<Employee> boss(n);
+	for (Employee e = 0; e < n; ++e)
+		boss[number[e]] = (e == 0 || my_rand() % 8 == 0) ? NO_EMPLOYEE : number[my_rand() % e];
+	std::vector<Price> gp(k);
+	for (Price &p : gp)
+		p = my_rand() % 20;
+	return test(naive_price(boss, gp), boss, gp, solve);
+}
+
+enum Shape : unsigned {
+	RANDOM_TREE, // random recursive tree, the boss of each employee is any of the employees before them
+	CHAIN,		 // every employee is the boss of the next one
+	STAR,		 // one boss of everybody else
+	SMALL_TREES	 // forest of random recursive trees of 1 to 64 employees
+};
+
+const char *shape_name(Shape shape) {
+	switch (shape) {
+		case RANDOM_TREE:
+			return "random tree";
+		case CHAIN:
+			return "chain";
+		case STAR:
+			return "star";
+		default:
+			return "small trees";
+	}
+}
+
+std::vector<Employee> generate_bosses(Shape shape, size_t n, std::mt19937 &my_rand) {
+	std::vector<Employee> boss(n);
+	Employee root = 0; // root of the current small tree
+	for (Employee e = 0; e < n; ++e) {
+		if (shape == SMALL_TREES && (e == 0 || my_rand() % 32 == 0))
+			root = e;
+		boss[e] = e == 0 ? NO_EMPLOYEE : shape == RANDOM_TREE ? my_rand() % e : shape == CHAIN ? e - 1 : shape == STAR ? 0 : e == root ? NO_EMPLOYEE : root + my_rand() % (e - root);
+	}
+	return boss;
+}
+
+// Compares a solver with the serial one on a big forest
+bool test_big(size_t n, Shape shape, const Solver &solve) {
+	std::mt19937 my_rand(24707 + n + shape);
+	std::vector<Employee> boss = generate_bosses(shape, n, my_rand);
+	std::vector<Price> gp(50);
+	for (Price &p : gp)
+		p = my_rand() % 1'000;
+	return test(optimize_gifts(boss, gp).first, boss, gp, solve);
+}
+
+// Every price list of a batch must be solved the same as on its own
+bool test_batch(size_t n, size_t scenarios, size_t threads) {
+	std::mt19937 my_rand(24707 + n + scenarios);
+	std::vector<Employee> boss(n);
+	for (Employee e = 0; e < n; ++e)
+		boss[e] = (e == 0 || my_rand() % 100 == 0) ? NO_EMPLOYEE : my_rand() % e;
+	std::vector<std::vector<Price>> gps(scenarios);
+	for (std::vector<Price> &gp : gps) {
+		gp.resize(2 + my_rand() % 100);
+		for (Price &p : gp)
+			p = my_rand() % 1'000;
+	}
+	std::vector<std::pair<Price, std::vector<Gift>>> results = optimize_gifts_batch(boss, gps, threads);
+	if (results.size() != scenarios) {
+		printf("Test failed: %zu results of %zu price lists.\n", results.size(), scenarios);
+		return false;
+	}
+	for (size_t i = 0; i < scenarios; ++i) {
+		if (results[i] != optimize_gifts(boss, gps[i])) {
+			printf("Test failed: price list %zu of the batch was solved differently.\n", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+// A chart solved from a binary file must give the same gifts as optimize_gifts
+bool test_chart_file(size_t n, size_t k, Shape shape) {
+	std::mt19937 my_rand(24707 + n + k);
+	std::vector<Employee> boss = generate_bosses(shape, n, my_rand);
+	std::vector<Price> gp(k);
+	for (Price &p : gp)
+		p = my_rand() % 1'000;
+	const char *input = "/tmp/hw3_test_chart.bin", *output = "/tmp/hw3_test_gifts.bin";
+	save_chart(input, boss, gp);
+	Price price = solve_chart(input, output);
+	auto [expectedPrice, expected] = optimize_gifts(boss, gp);
+	bool ok = price == expectedPrice;
+	{
+		MappedFile gifts(output);
+		for (Employee e = 0; e < n && ok; ++e)
+			ok = (k <= NARROW_COLORS ? ((const uint16_t *)gifts.data())[e] : ((const uint32_t *)gifts.data())[e]) == expected[e];
+	}
+	std::remove(input);
+	std::remove(output);
+	if (!ok)
+		printf("Test failed: binary chart of %zu employees and %zu gifts was solved differently.\n", n, k);
+	return ok;
+}
+
+// Damaged charts must be rejected before anything is read out of the file or written out of the forest
+bool test_bad_charts() {
+	const char *input = "/tmp/hw3_test_chart.bin", *output = "/tmp/hw3_test_gifts.bin";
+	auto rejected = [&](const ChartHeader &header, const std::vector<uint32_t> &bosses, const std::vector<Price> &prices) {
+		{
+			std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(input, "wb"), fclose);
+			fwrite(&header, sizeof(header), 1, file.get());
+			if (!bosses.empty())
+				fwrite(bosses.data(), sizeof(uint32_t), bosses.size(), file.get());
+			fwrite(prices.data(), sizeof(Price), prices.size(), file.get());
+		}
+		bool ok = false;
+		try {
+			solve_chart(input, output);
+		} catch (const std::invalid_argument &) {
+			ok = true;
+		} catch (const std::length_error &) {
+			ok = true;
+		}
+		std::remove(input);
+		std::remove(output);
+		return ok;
+	};
+	const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+	bool ok = true;
+	// the padded number of employees wraps around in 32 bits
+	ok = ok && rejected({{'H', 'W', '3', 'C'}, NONE, 2}, {}, {1, 2});
+	// the size of the prices wraps around in 64 bits
+	ok = ok && rejected({{'H', 'W', '3', 'C'}, 2, ((uint64_t)1 << 61) + 2}, {NONE, 0}, {1, 2});
+	// a boss which is not an employee
+	ok = ok && rejected({{'H', 'W', '3', 'C'}, 2, 2}, {NONE, 7}, {1, 2});
+	// employees 1 and 2 are each other's boss
+	ok = ok && rejected({{'H', 'W', '3', 'C'}, 3, 2}, {NONE, 2, 1, 0}, {1, 2});
+	// an employee is their own boss
+	ok = ok && rejected({{'H', 'W', '3', 'C'}, 2, 2}, {NONE, 1}, {1, 2});
+	if (!ok)
+		printf("Test failed: a damaged binary chart was accepted.\n");
+	return ok;
+}
+
+// The cheapest coloring keeping the capacities, by trying all of them, or the maximum if there is none
+Price naive_capacitated_price(const std::vector<Employee> &boss, const std::vector<Price> &gp, const std::vector<size_t> &capacity) {
+	Price best = std::numeric_limits<Price>::max();
+	std::vector<Gift> gifts(boss.size(), 0);
+	while (true) {
+		std::vector<size_t> count(gp.size(), 0);
+		Price price = 0;
+		bool ok = true;
+		for (Employee e = 0; e < boss.size() && ok; ++e) {
+			ok = ++count[gifts[e]] <= capacity[gifts[e]] && (boss[e] == NO_EMPLOYEE || gifts[boss[e]] != gifts[e]);
+			price += gp[gifts[e]];
+		}
+		if (ok)
+			best = std::min(best, price);
+		Employee e = 0;
+		while (e < boss.size() && ++gifts[e] == gp.size())
+			gifts[e++] = 0;
+		if (e == boss.size())
+			return best;
+	}
+}
+
+// The capacitated optimizer must keep the capacities, its lower bound must hold and with no real capacities it must find the optimum
+bool test_capacitated(size_t n, size_t k, size_t seed) {
+	std::mt19937 my_rand(24707 + seed);
+	std::vector<Employee> boss(n);
+	for (Employee e = 0; e < n; ++e)
+		boss[e] = (e == 0 || my_rand() % 4 == 0) ? NO_EMPLOYEE : my_rand() % e;
+	std::vector<Price> gp(k);
+	for (Price &p : gp)
+		p = my_rand() % 20;
+	std::vector<size_t> capacity(k);
+	for (size_t &c : capacity)
+		c = 1 + my_rand() % (n / 2 + 1);
+
+	Price optimal = naive_capacitated_price(boss, gp, capacity);
+	CapacitatedResult result = optimize_gifts_capacitated(boss, gp, capacity);
+	if (optimal != std::numeric_limits<Price>::max() && result.lowerBound > optimal) {
+		printf("Test failed: lower bound %llu is above the optimum %llu.\n", result.lowerBound, optimal);
+		return false;
+	}
+	if (result.feasible) {
+		std::vector<size_t> count(k, 0);
+		Price price = 0;
+		for (Employee e = 0; e < n; ++e) {
+			price += gp[result.gifts[e]];
+			if (++count[result.gifts[e]] > capacity[result.gifts[e]] || (boss[e] != NO_EMPLOYEE && result.gifts[boss[e]] == result.gifts[e])) {
+				printf("Test failed: gift of employee %zu breaks a capacity or equals the gift of the boss.\n", e);
+				return false;
+			}
+		}
+		if (price != result.price || price < optimal) {
+			printf("Test failed: capacitated price %llu, reported %llu, optimum %llu.\n", price, result.price, optimal);
+			return false;
+		}
+	}
+
+	result = optimize_gifts_capacitated(boss, gp, std::vector<size_t>(k, n));
+	if (!result.feasible || result.price != optimize_gifts(boss, gp).first) {
+		printf("Test failed: unlimited capacities gave price %llu.\n", result.price);
+		return false;
+	}
+	return true;
+}
+
+// Every kernel the processor supports must choose the two cheapest candidates of a naive search, with the ties going to the lower color
+bool test_kernels() {
+	std::mt19937 my_rand(24707);
+	for (size_t count = 1; count <= 100; ++count) {
+		std::vector<Price> prices(100), corrections(100);
+		for (size_t i = 0; i < prices.size(); ++i) {
+			prices[i] = my_rand() % 10;
+			corrections[i] = my_rand() % 5 ? my_rand() % 10 : std::numeric_limits<Price>::max() / 2;
+		}
+		std::vector<Gift> colors(prices.size());
+		for (Gift g = 0; g < colors.size(); ++g)
+			colors[g] = g;
+		std::shuffle(colors.begin(), colors.end(), my_rand);
+
+		auto cost = [&](size_t i) { return std::make_pair(prices[colors[i]] + 7 + corrections[colors[i]], colors[i]); };
+		size_t first = 0, second = count; // none yet
+		for (size_t i = 1; i < count; ++i) {
+			if (cost(i) < cost(first))
+				first = i;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			if (i != first && (second == count || cost(i) < cost(second)))
+				second = i;
+		}
+
+		for (kernels::Level level = kernels::SCALAR; level <= kernels::detect(); level = (kernels::Level)(level + 1)) {
+			kernels::BestTwo got = kernels::bestTwo(level)(prices.data(), corrections.data(), 7, colors.data(), count);
+			if (got.first != first || got.min1 != cost(first).first || (count > 1 && (got.second != second || got.min2 != cost(second).first))) {
+				printf("Test failed: kernel %d chose (%zu, %zu) instead of (%zu, %zu) of %zu colors.\n", level, got.first, got.second, first, second, count);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Solving the same inputs again must not allocate anything but the result
+bool test_allocations(size_t n, size_t k) {
+	std::mt19937 my_rand(24707 + n);
+	std::vector<Employee> boss(n);
+	for (Employee e = 0; e < n; ++e)
+		boss[e] = (e == 0 || my_rand() % 100 == 0) ? NO_EMPLOYEE : my_rand() % e;
+	std::vector<Price> gp(k);
+	for (Price &p : gp)
+		p = my_rand() % 1'000;
+
+	GiftGraphs graphs;
+	Price first = optimize_gifts_reusing(boss, gp, graphs).first;
+	size_t before = g_allocations;
+	auto [price, gifts] = optimize_gifts_reusing(boss, gp, graphs);
+	size_t allocations = g_allocations - before;
+	if (allocations != 1 || price != first) {
+		printf("Test failed: solving again allocated %zu times.\n", allocations);
+		return false;
+	}
+	// released graphs allocate again, and solve the same
+	graphs.release();
+	before = g_allocations;
+	price = optimize_gifts_reusing(boss, gp, graphs).first;
+	if (g_allocations - before <= 1 || price != first) {
+		printf("Test failed: released graphs allocated %zu times.\n", g_allocations - before);
+		return false;
+	}
+	return true;
+}
+
+// Applies random changes to the org chart and the prices, comparing the incremental optimizer with solving from scratch
+// The departed employees are left out of the chart solved from scratch, the others are renumbered
+bool test_incremental(size_t n, size_t k, size_t changes, size_t seed) {
+	std::mt19937 my_rand(24707 + seed);
+	std::vector<Employee> boss(n);
+	for (Employee e = 0; e < n; ++e)
+		boss[e] = (e == 0 || my_rand() % 8 == 0) ? NO_EMPLOYEE : my_rand() % e;
+	std::vector<Price> gp(k);
+	for (Price &p : gp)
+		p = my_rand() % 20;
+	std::vector<bool> departed(n, false);
+	GiftOptimizer optimizer(boss, gp);
+	Solver incremental = [&optimizer, &departed](const std::vector<Employee> &, const std::vector<Price> &) {
+		std::vector<Gift> gifts;
+		std::vector<Gift> all = optimizer.gifts();
+		for (Employee e = 0; e < all.size(); ++e) {
+			if (departed[e] != (all[e] == GiftOptimizer::NO_GIFT))
+				return std::make_pair(Price(0), std::vector<Gift>());
+			if (!departed[e])
+				gifts.push_back(all[e]);
+		}
+		return std::make_pair(optimizer.price(), gifts);
+	};
+	auto present = [&]() {
+		Employee e;
+		do {
+			e = my_rand() % boss.size();
+		} while (departed[e]);
+		return e;
+	};
+
+	for (size_t i = 0; i < changes; ++i) {
+		switch (my_rand() % 5) {
+			case 0: {
+				Gift g = my_rand() % k;
+				gp[g] = my_rand() % 20;
+				optimizer.setPrice(g, gp[g]);
+				break;
+			}
+			case 1: {
+				boss.push_back(my_rand() % 4 == 0 ? NO_EMPLOYEE : present());
+				departed.push_back(false);
+				optimizer.hire(boss.back());
+				break;
+			}
+			case 2: {
+				// the last employee stays, so that there is always someone to pick
+				if (std::count(departed.begin(), departed.end(), false) == 1)
+					break;
+				Employee e = present();
+				for (Employee &b : boss)
+					if (b == e)
+						b = boss[e];
+				boss[e] = NO_EMPLOYEE;
+				departed[e] = true;
+				optimizer.depart(e);
+				break;
+			}
+			default: {
+				// a new boss which is not a subordinate of the employee
+				Employee e = present();
+				Employee b = my_rand() % 5 == 0 ? NO_EMPLOYEE : present();
+				bool cycle = false;
+				for (Employee visiting = b; visiting != NO_EMPLOYEE; visiting = boss[visiting])
+					cycle = cycle || visiting == e;
+				if (cycle)
+					break;
+				boss[e] = b;
+				optimizer.reassign(e, b);
+			}
+		}
+		std::vector<Employee> number(boss.size()), remaining;
+		for (Employee e = 0; e < boss.size(); ++e) {
+			if (!departed[e]) {
+				number[e] = remaining.size();
+				remaining.push_back(boss[e]);
+			}
+		}
+		for (Employee &b : remaining)
+			if (b != NO_EMPLOYEE)
+				b = number[b];
+		if (!test(optimize_gifts(remaining, gp).first, remaining, gp, incremental))
+			return false;
+	}
+	return true;
+}
+
+// Times the construction of the graph and the coloring separately on a random tree with n employees and k gifts
+// The coloring is serial, unless the number of threads is given
+void benchmark(size_t n, size_t k, size_t threads = 0) {
+	using Clock = std::chrono::steady_clock;
+	std::mt19937 my_rand(24707 + n);
+	std::vector<Employee> boss(n);
+	for (Employee e = 0; e < n; ++e)
+		boss[e] = e == 0 ? NO_EMPLOYEE : my_rand() % e;
+	std::vector<Price> gp(k);
+	for (Price &p : gp)
+		p = my_rand() % 1'000'000;
+
+	Clock::time_point start = Clock::now();
+	Graph g(boss, gp);
+	Clock::time_point built = Clock::now();
+	if (threads) {
+		g.colorGraphParallel(threads);
+	} else {
+		g.colorGraph();
+	}
+	auto [price, gifts] = g.getResult();
+	Clock::time_point solved = Clock::now();
+
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("n = %zu, k = %zu, threads = %zu: build %.3f s, solve %.3f s, peak memory %ld MiB (price %llu)\n", n, k, threads,
+		   std::chrono::duration<double>(built - start).count(),
+		   std::chrono::duration<double>(solved - built).count(),
+		   usage.ru_maxrss / 1024, price);
+}
+
+// Times single reassignments, price changes and departures of the incremental optimizer on a random tree, compared to solving from scratch
+void benchmark_incremental(size_t n, size_t k, size_t changes = 10'000) {
+	using Clock = std::chrono::steady_clock;
+	std::mt19937 my_rand(24707 + n);
+	std::vector<Employee> boss(n);
+	for (Employee e = 0; e < n; ++e)
+		boss[e] = e == 0 ? NO_EMPLOYEE : my_rand() % e;
+	std::vector<Price> gp(k);
+	for (Price &p : gp)
+		p = my_rand() % 1'000'000;
+
+	Clock::time_point start = Clock::now();
+	optimize_gifts(boss, gp);
+	Clock::time_point solved = Clock::now();
+	GiftOptimizer optimizer(boss, gp);
+	Clock::time_point built = Clock::now();
+	for (size_t i = 0; i < changes; ++i) {
+		// moving a leaf never creates a cycle
+		Employee e = n - 1 - my_rand() % (n / 2);
+		optimizer.reassign(e, my_rand() % (n / 2));
+	}
+	Clock::time_point reassigned = Clock::now();
+	for (size_t i = 0; i < changes; ++i) {
+		optimizer.setPrice(my_rand() % k, my_rand() % 1'000'000);
+	}
+	Clock::time_point priced = Clock::now();
+	for (size_t i = 0; i < changes; ++i) {
+		// different employees, so that none of them departs twice
+		optimizer.depart(i * (n / changes));
+	}
+	Clock::time_point departed = Clock::now();
+
+	printf("n = %zu, k = %zu: full solve %.3f s, optimizer build %.3f s, reassign %.2f us, price change %.2f us, departure %.2f us (price %llu)\n", n, k,
+		   std::chrono::duration<double>(solved - start).count(),
+		   std::chrono::duration<double>(built - solved).count(),
+		   std::chrono::duration<double, std::micro>(reassigned - built).count() / changes,
+		   std::chrono::duration<double, std::micro>(priced - reassigned).count() / changes,
+		   std::chrono::duration<double, std::micro>(departed - priced).count() / changes,
+		   optimizer.price());
+}
+
+// Times the phases of optimize_gifts: building the forest (counting sort of the children and the breadth first renumbering),
+// the state of the vertices and the sorted gifts, the bottom-up coloring, the top-down tracing and the result in the original order.
+// The peak memory is the one of the whole process so far.
+template <typename Color>
+void benchmark_phases(Shape shape, size_t n, size_t k) {
+	using Clock = std::chrono::steady_clock;
+	std::mt19937 my_rand(24707 + n + shape);
+	std::vector<Employee> boss = generate_bosses(shape, n, my_rand);
+	std::vector<Price> gp(k);
+	for (Price &p : gp)
+		p = my_rand() % 1'000'000;
+
+	Clock::time_point start = Clock::now();
+	Forest forest;
+	forest.init(boss);
+	Clock::time_point built = Clock::now();
+	BasicGraph<Color> g;
+	g.init(forest, gp);
+	Clock::time_point sorted = Clock::now();
+	g.colorVertices();
+	Clock::time_point colored = Clock::now();
+	g.traceVertices();
+	Clock::time_point traced = Clock::now();
+	auto [price, gifts] = g.getResult();
+	Clock::time_point done = Clock::now();
+
+	auto ms = [](Clock::time_point from, Clock::time_point to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("%-11s n = %8zu, k = %7zu: total %8.1f ms (forest %7.1f, setup %6.1f, coloring %7.1f, tracing %6.1f, result %6.1f), peak memory %5ld MiB (price %llu)\n",
+		   shape_name(shape), n, k, ms(start, done), ms(start, built), ms(built, sorted), ms(sorted, colored), ms(colored, traced), ms(traced, done),
+		   usage.ru_maxrss / 1024, price);
+}
+
+// All shapes up to the given number of employees, with narrow and wide catalogs of gifts
+void benchmark_all(size_t maxEmployees = 10'000'000) {
+	for (size_t n = 1'000; n <= maxEmployees; n *= 10) {
+		for (Shape shape : {RANDOM_TREE, CHAIN, STAR, SMALL_TREES}) {
+			benchmark_phases<uint16_t>(shape, n, 10);
+		}
+	}
+	for (size_t k = 1'000; k <= maxEmployees / 10; k *= 10) {
+		for (Shape shape : {RANDOM_TREE, STAR}) {
+			if (k <= NARROW_COLORS)
+				benchmark_phases<uint16_t>(shape, maxEmployees / 10, k);
+			else
+				benchmark_phases<uint32_t>(shape, maxEmployees / 10, k);
+		}
+	}
+}
+
+// Times solving a binary org chart, the peak memory is meaningful only if nothing else ran before
+void benchmark_chart_file(size_t n, size_t k) {
+	using Clock = std::chrono::steady_clock;
+	const char *input = "/tmp/hw3_chart.bin", *output = "/tmp/hw3_gifts.bin";
+	{
+		std::mt19937 my_rand(24707 + n);
+		std::vector<Employee> boss = generate_bosses(RANDOM_TREE, n, my_rand);
+		std::vector<Price> gp(k);
+		for (Price &p : gp)
+			p = my_rand() % 1'000'000;
+		save_chart(input, boss, gp);
+	}
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	long before = usage.ru_maxrss;
+	Clock::time_point start = Clock::now();
+	Price price = solve_chart(input, output);
+	Clock::time_point done = Clock::now();
+	getrusage(RUSAGE_SELF, &usage);
+	printf("binary chart n = %zu, k = %zu: %.3f s, peak memory %ld MiB, %ld MiB more than while generating (price %llu)\n", n, k,
+		   std::chrono::duration<double>(done - start).count(), usage.ru_maxrss / 1024, (usage.ru_maxrss - before) / 1024, price);
+	std::remove(input);
+	std::remove(output);
+}
+
+// Times the capacitated optimizer on a random tree where every gift can be given to at most twice its share of the employees
+void benchmark_capacitated(size_t n, size_t k, size_t iterations = 10) {
+	using Clock = std::chrono::steady_clock;
+	std::mt19937 my_rand(24707 + n);
+	std::vector<Employee> boss = generate_bosses(RANDOM_TREE, n, my_rand);
+	std::vector<Price> gp(k);
+	for (Price &p : gp)
+		p = my_rand() % 1'000'000;
+	std::vector<size_t> capacity(k, 2 * n / k + 1);
+
+	Clock::time_point start = Clock::now();
+	Price unconstrained = optimize_gifts(boss, gp).first;
+	Clock::time_point single = Clock::now();
+	CapacitatedResult result = optimize_gifts_capacitated(boss, gp, capacity, iterations);
+	Clock::time_point done = Clock::now();
+	printf("n = %zu, k = %zu, %zu iterations: %.3f s (%.3f s unconstrained), price %llu (%s), lower bound %llu, unconstrained %llu\n", n, k, iterations,
+		   std::chrono::duration<double>(done - single).count(), std::chrono::duration<double>(single - start).count(),
+		   result.price, result.feasible ? "feasible" : "infeasible", result.lowerBound, unconstrained);
+}
+
+// Times a batch of price lists on a random tree, compared to solving them one by one
+void benchmark_batch(size_t n, size_t scenarios, size_t threads = std::thread::hardware_concurrency()) {
+	using Clock = std::chrono::steady_clock;
+	std::mt19937 my_rand(24707 + n);
+	std::vector<Employee> boss(n);
+	for (Employee e = 0; e < n; ++e)
+		boss[e] = e == 0 ? NO_EMPLOYEE : my_rand() % e;
+	std::vector<std::vector<Price>> gps(scenarios, std::vector<Price>(100));
+	for (std::vector<Price> &gp : gps)
+		for (Price &p : gp)
+			p = my_rand() % 1'000'000;
+
+	Clock::time_point start = Clock::now();
+	Price sum = 0;
+	for (const std::vector<Price> &gp : gps)
+		sum += optimize_gifts(boss, gp).first;
+	Clock::time_point single = Clock::now();
+	for (const std::pair<Price, std::vector<Gift>> &result : optimize_gifts_batch(boss, gps, threads))
+		sum -= result.first;
+	Clock::time_point batch = Clock::now();
+	printf("n = %zu, %zu price lists: one by one %.3f s, batch on %zu threads %.3f s%s\n", n, scenarios,
+		   std::chrono::duration<double>(single - start).count(), threads,
+		   std::chrono::duration<double>(batch - single).count(), sum ? " (different prices!)" : "");
+}
+
+// Times the kernels choosing the two best colors of a vertex with the given number of candidate colors, as a wide vertex with a large gift list has
+void benchmark_kernels(size_t candidates, size_t repeats = 1'000'000 / 64) {
+	using Clock = std::chrono::steady_clock;
+	std::mt19937 my_rand(24707 + candidates);
+	std::vector<Price> prices(candidates * 4), corrections(candidates * 4);
+	for (size_t i = 0; i < prices.size(); ++i) {
+		prices[i] = my_rand() % 1'000'000;
+		corrections[i] = my_rand() % 1'000'000;
+	}
+	std::vector<Gift> colors(prices.size());
+	for (Gift g = 0; g < colors.size(); ++g)
+		colors[g] = g;
+	std::shuffle(colors.begin(), colors.end(), my_rand);
+
+	printf("%zu candidates:", candidates);
+	for (kernels::Level level = kernels::SCALAR; level <= kernels::detect(); level = (kernels::Level)(level + 1)) {
+		kernels::BestTwoKernel kernel = kernels::bestTwo(level);
+		size_t sink = 0;
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < repeats; ++i)
+			sink += kernel(prices.data(), corrections.data(), i, colors.data(), candidates).first;
+		double time = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / repeats;
+		printf(" %s %.1f ns (%.2f ns per color)%s", level == kernels::SCALAR ? "scalar" : "avx512", time, time / candidates, sink == 1 ? " " : "");
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[]) {
 	int ok = 0, fail = 0;
 	for (auto &&[p, b, gp] : EXAMPLES)
 		(test(p, b, gp) ? ok : fail)++;
+	for (size_t seed = 0; seed < 200; ++seed)
+		(test_random(1 + seed % 40, 2 + seed % 7, seed) ? ok : fail)++;
+
+	Solver parallel = [](const std::vector<Employee> &boss, const std::vector<Price> &gp) { return optimize_gifts_parallel(boss, gp, 4); };
+	for (auto &&[p, b, gp] : EXAMPLES)
+		(test(p, b, gp, parallel) ? ok : fail)++;
+	for (size_t seed = 0; seed < 200; ++seed)
+		(test_random(1 + seed % 40, 2 + seed % 7, seed, parallel) ? ok : fail)++;
+	for (Shape shape : {RANDOM_TREE, CHAIN, STAR, SMALL_TREES})
+		(test_big(200'000, shape, parallel) ? ok : fail)++;
+	(test_allocations(100'000, 100) ? ok : fail)++;
+	(test_kernels() ? ok : fail)++;
+	for (kernels::Level level = kernels::SCALAR; level <= kernels::detect(); level = (kernels::Level)(level + 1)) {
+		Solver withKernel = [level](const std::vector<Employee> &boss, const std::vector<Price> &gp) {
+			Graph g(boss, gp);
+			g.setKernel(level);
+			g.colorGraph();
+			return g.getResult();
+		};
+		for (size_t seed = 0; seed < 50; ++seed)
+			(test_random(1 + seed % 40, 2 + seed % 7, seed, withKernel) ? ok : fail)++;
+		(test_big(200'000, STAR, withKernel) ? ok : fail)++;
+	}
+	for (size_t threads = 1; threads <= 4; threads *= 2)
+		(test_batch(10'000, 7, threads) ? ok : fail)++;
+	(test_batch(100, 0, 4) ? ok : fail)++;
+	for (Shape shape : {RANDOM_TREE, CHAIN, STAR, SMALL_TREES})
+		(test_chart_file(10'001, 50, shape) ? ok : fail)++;
+	(test_chart_file(1'000, 100'000, RANDOM_TREE) ? ok : fail)++;
+	(test_chart_file(0, 2, RANDOM_TREE) ? ok : fail)++;
+	(test_bad_charts() ? ok : fail)++;
+	for (size_t seed = 0; seed < 300; ++seed)
+		(test_capacitated(1 + seed % 8, 2 + seed % 3, seed) ? ok : fail)++;
+	for (size_t seed = 0; seed < 50; ++seed)
+		(test_incremental(1 + seed % 30, seed % 3 == 0 ? 2 + seed % 5 : 10 + seed % 30, 50, seed) ? ok : fail)++;
 
 	if (!fail)
 		printf("Passed all %d tests!\n", ok);
 	else
 		printf("Failed %d of %d tests.", fail, fail + ok);
+
+	// the benchmarks take minutes, they run only when asked for
+	if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+		benchmark_all();
+		benchmark(10'000'000, 10);
+		benchmark(10'000'000, 10, std::thread::hardware_concurrency());
+		benchmark_incremental(1'000'000, 1'000);
+		benchmark_batch(1'000'000, 32);
+		benchmark_chart_file(10'000'000, 100);
+		benchmark_capacitated(10'000'000, 100);
+		for (size_t candidates = 16; candidates <= 4096; candidates *= 4)
+			benchmark_kernels(candidates);
+	}
 }
 
 #endif